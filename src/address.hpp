@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+namespace demo
+{
+
+    // TCP ports or Unix domain sockets "unix:<path>", abstract if the path starts with '@'
+    constexpr std::string_view unix_prefix = "unix:";
+
+    inline bool is_unix_address(std::string_view address)
+    {
+        return address.substr(0, unix_prefix.size()) == unix_prefix;
+    }
+
+    // the path in the format of sockaddr_un, i.e. with a leading NUL byte
+    // for the abstract namespace
+    inline auto unix_path(std::string_view address) -> std::string
+    {
+        std::string result(address.substr(unix_prefix.size()));
+        if (!result.empty() && result[0] == '@') {
+            result[0] = '\0';
+        }
+        return result;
+    }
+
+    // removes a stale socket file of a previous run before binding
+    inline void unix_unlink(const std::string& path)
+    {
+        if (!path.empty() && path[0] != '\0') {
+            ::unlink(path.c_str());
+        }
+    }
+
+    inline auto tcp_port(std::string_view address) -> unsigned short
+    {
+        std::size_t end = 0;
+        auto port = std::stoul(std::string(address), &end);
+        if (end != address.size() || port > 65535) {
+            throw std::runtime_error("invalid-port");
+        }
+        return static_cast<unsigned short>(port);
+    }
+
+}
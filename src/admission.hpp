@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <sys/socket.h>
+
+namespace demo
+{
+
+    // pause stops accepting, reject refuses new connections with the busy response
+    enum class overload_policy { pause, reject };
+
+    inline auto parse_overload_policy(std::string_view name) -> overload_policy
+    {
+        if (name == "pause") {
+            return overload_policy::pause;
+        } else if (name == "reject") {
+            return overload_policy::reject;
+        } else {
+            throw std::runtime_error("overload-policy-error");
+        }
+    }
+
+    // limits of the whole server, where 0 means unlimited
+    class admission
+    {
+    private: // --- scope ---
+        using self = admission;
+    private: // --- state ---
+        std::size_t _max_connections;
+        std::size_t _max_queued;
+        overload_policy _policy;
+        std::atomic<std::size_t> _connections{0};
+        std::atomic<bool> _waiting{false};
+        std::mutex _mutex;
+        std::vector<std::function<void()>> _waiters;
+    public: // --- life ---
+        explicit admission(std::size_t max_connections, std::size_t max_queued, overload_policy policy)
+            : _max_connections(max_connections), _max_queued(max_queued), _policy(policy)
+        { }
+        admission(const self& rhs) = delete;
+        admission(self&& rhs) noexcept = delete;
+        ~admission() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto policy() const { return _policy; }
+        bool full() const
+        {
+            return _max_connections != 0 && _connections.load() >= _max_connections;
+        }
+        // counts a connection, false at the limit; with pause before the
+        // accept, so that concurrent acceptors cannot exceed the limit
+        bool reserve()
+        {
+            auto connections = _connections.load();
+            do {
+                if (_max_connections != 0 && connections >= _max_connections) {
+                    return false;
+                }
+            } while (!_connections.compare_exchange_weak(connections, connections + 1));
+            return true;
+        }
+        // resumes the waiters, if any
+        void release()
+        {
+            _connections.fetch_sub(1);
+            if (_waiting.load()) {
+                std::vector<std::function<void()>> waiters;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    waiters.swap(_waiters);
+                    _waiting = false;
+                }
+                for (auto&& waiter : waiters) {
+                    waiter();
+                }
+            }
+        }
+        // whether the offload pool may queue another request
+        bool admits_request(std::size_t queued) const
+        {
+            return _max_queued == 0 || queued < _max_queued;
+        }
+        void async_await_connection(std::function<void()> function)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                // set before the check, so that a concurrent release sees it
+                _waiting = true;
+                if (full()) {
+                    _waiters.push_back(std::move(function));
+                    return;
+                }
+            }
+            function();
+        }
+        // blocks until a connection is reserved
+        void await_connection()
+        {
+            while (!reserve()) {
+                auto promise = std::make_shared<std::promise<void>>();
+                auto resumed = promise->get_future();
+                async_await_connection([promise] { promise->set_value(); });
+                resumed.wait();
+            }
+        }
+        // sends the busy response to a rejected connection before it is closed
+        static void refuse(int fd, std::string_view busy)
+        {
+            [[maybe_unused]] auto rv = ::send(fd, busy.data(), busy.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+    };
+
+}
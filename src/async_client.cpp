@@ -1,5 +1,10 @@
-#include <list>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <fstream>
 #include <mutex>
+#include <numeric>
+#include <optional>
 #include <random>
 #include <thread>
 #include <vector>
@@ -8,10 +13,14 @@
 #include "boost/asio/steady_timer.hpp"
 #include "boost/asio/system_timer.hpp"
 
+#include "address.hpp"
+#include "capture.hpp"
 #include "command_line.hpp"
 #include "log.hpp"
 #include "partition.hpp"
+#include "protocol.hpp"
 #include "thread.hpp"
+#include "transport.hpp"
 
 
 namespace
@@ -28,10 +37,13 @@ namespace
 
     using error_code = boost::system::error_code;
     using tcp = asio::ip::tcp;
+    // TCP or Unix domain sockets
+    using stream_protocol = asio::generic::stream_protocol;
 
     using clock = std::chrono::system_clock;
     using time_point = clock::time_point;
     using duration = std::chrono::duration<double>;
+    using steady_clock = std::chrono::steady_clock;
 
     using owner = std::shared_ptr<void>;
 
@@ -61,50 +73,566 @@ namespace
     do { abort_on_error_aux(ec, " file:", __FILE__, " line:", __LINE__, " func:", __PRETTY_FUNCTION__, __VA_ARGS__); } while (false)
 
 
+    // serializes the lines written by the client threads
+    std::mutex output_mutex;
+
+
+    // bucket i contains durations in [2^i, 2^(i+1)) microseconds
+    class histogram
+    {
+    public: // --- scope ---
+        static constexpr std::size_t bucket_count = 32;
+        using counts = std::array<std::uint64_t, bucket_count>;
+    private: // --- state ---
+        std::array<std::atomic<std::uint64_t>, bucket_count> _buckets{};
+    public: // --- operations ---
+        void add(steady_clock::duration duration)
+        {
+            auto us = static_cast<std::uint64_t>(std::max<std::int64_t>(
+                std::chrono::duration_cast<microseconds>(duration).count(), 0));
+            std::size_t bucket = 0;
+            while (bucket + 1 < bucket_count && (us >> (bucket + 1)) != 0) {
+                ++bucket;
+            }
+            _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+        auto load() const -> counts
+        {
+            counts result;
+            for (std::size_t b = 0; b != bucket_count; ++b) {
+                result[b] = _buckets[b].load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+        // upper bound of the bucket with the percentile of the counts between the snapshots
+        static auto percentile(const counts& current, const counts& previous, double ratio) -> std::uint64_t
+        {
+            auto b = bucket(current, previous, ratio);
+            return b == bucket_count ? 0 : std::uint64_t(1) << (b + 1);
+        }
+        // bucket with the percentile, or bucket_count if there are none
+        static auto bucket(const counts& current, const counts& previous, double ratio) -> std::size_t
+        {
+            std::uint64_t total = 0;
+            for (std::size_t b = 0; b != bucket_count; ++b) {
+                total += current[b] - previous[b];
+            }
+            auto threshold = static_cast<std::uint64_t>(ratio * double(total));
+            std::uint64_t sum = 0;
+            for (std::size_t b = 0; b != bucket_count; ++b) {
+                sum += current[b] - previous[b];
+                if (sum > threshold) {
+                    return b;
+                }
+            }
+            return bucket_count;
+        }
+    };
+
+
+    // bucket 0 contains durations below 100 ns, bucket i those in [100 * 2^(i-1), 100 * 2^i) ns
+    class fine_histogram
+    {
+    public: // --- scope ---
+        static constexpr std::uint64_t resolution = 100;
+    private: // --- state ---
+        std::array<std::atomic<std::uint64_t>, histogram::bucket_count> _buckets{};
+    public: // --- operations ---
+        void add(steady_clock::duration duration)
+        {
+            auto ticks = static_cast<std::uint64_t>(std::max<std::int64_t>(
+                std::chrono::duration_cast<nanoseconds>(duration).count(), 0)) / resolution;
+            std::size_t bucket = 0;
+            while (bucket + 1 < histogram::bucket_count && (ticks >> bucket) != 0) {
+                ++bucket;
+            }
+            _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+        auto load() const -> histogram::counts
+        {
+            histogram::counts result;
+            for (std::size_t b = 0; b != histogram::bucket_count; ++b) {
+                result[b] = _buckets[b].load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+        // upper bound in nanoseconds, see histogram::percentile
+        static auto percentile(const histogram::counts& current, const histogram::counts& previous, double ratio) -> std::uint64_t
+        {
+            auto b = histogram::bucket(current, previous, ratio);
+            return b == histogram::bucket_count ? 0 : resolution << b;
+        }
+    };
+
+
+    // counters and histograms of all threads, printed as the changes since
+    // the previous report on a line with the prefix
+    template <std::size_t Counters, std::size_t Histograms, typename Histogram = histogram>
+    class reporter
+    {
+    private:
+        using self = reporter;
+        struct values
+        {
+            std::array<std::uint64_t, Counters> _counters{};
+            std::array<histogram::counts, Histograms> _histograms{};
+        };
+    private: // --- state ---
+        std::string_view _prefix;
+        std::vector<double> _ratios;
+        std::array<std::atomic<std::uint64_t>, Counters> _counters{};
+        std::array<Histogram, Histograms> _histograms;
+        values _previous;
+    public: // --- life ---
+        explicit reporter(std::string_view prefix, std::vector<double> ratios = {0.5, 0.99})
+            : _prefix(prefix), _ratios(std::move(ratios))
+        { }
+        reporter(const self& rhs) = delete;
+        reporter(self&& rhs) noexcept = delete;
+        ~reporter() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        void add(std::size_t counter)
+        {
+            _counters[counter].fetch_add(1, std::memory_order_relaxed);
+        }
+        void add(std::size_t histogram, steady_clock::duration duration)
+        {
+            _histograms[histogram].add(duration);
+        }
+        void print(std::ostream& os, long long timestamp)
+        {
+            values current;
+            for (std::size_t c = 0; c != Counters; ++c) {
+                current._counters[c] = _counters[c].load(std::memory_order_relaxed);
+            }
+            for (std::size_t h = 0; h != Histograms; ++h) {
+                current._histograms[h] = _histograms[h].load();
+            }
+            if (current._counters != _previous._counters || current._histograms != _previous._histograms) {
+                std::unique_lock<std::mutex> lock(output_mutex);
+                os << _prefix << ": " << timestamp;
+                for (std::size_t c = 0; c != Counters; ++c) {
+                    os << " " << current._counters[c] - _previous._counters[c];
+                }
+                for (std::size_t h = 0; h != Histograms; ++h) {
+                    for (auto ratio : _ratios) {
+                        os << " " << Histogram::percentile(current._histograms[h], _previous._histograms[h], ratio);
+                    }
+                }
+                os << std::endl;
+            }
+            _previous = current;
+        }
+    };
+
+
+    // the first response includes the wait in the accept queue of the server
+    namespace connect_metrics
+    {
+        enum counter : std::size_t { attempts, connects, errors, failures, counter_count };
+        enum latency : std::size_t { connect, first_response, latency_count };
+    }
+
+    reporter<connect_metrics::counter_count, connect_metrics::latency_count> global_connect_metrics("CONNECT");
+
+
+    // close is the time from the shutdown of the sending side until the server has closed its side
+    namespace churn_metrics
+    {
+        enum counter : std::size_t { cycles, completed, errors, counter_count };
+        enum latency : std::size_t { connect, first_response, close, latency_count };
+    }
+
+    reporter<churn_metrics::counter_count, churn_metrics::latency_count> global_churn_metrics("CHURN");
+
+
+    // lateness and intervals of the open loop and replay drivers in nanoseconds
+    namespace pacing_metrics
+    {
+        enum counter : std::size_t { requests, counter_count };
+        enum latency : std::size_t { lateness, intended, achieved, latency_count };
+    }
+
+    reporter<pacing_metrics::counter_count, pacing_metrics::latency_count, fine_histogram> global_pacing_metrics("PACING", {0.1, 0.5, 0.99});
+
+
+    // rejected requests were answered with the busy response of the server
+    namespace request_metrics
+    {
+        enum counter : std::size_t { failed, rejected, counter_count };
+    }
+
+    reporter<request_metrics::counter_count, 0> global_request_metrics("REQUESTS");
+
+
+    // request stream of all threads, if it is captured
+    std::unique_ptr<capture_writer> global_capture;
+
+    // busy response of the protocol, which the server sends before it closes
+    std::string_view global_busy_response;
+
+    // error of the requests answered with the busy response
+    const error_code busy_error = boost::system::errc::make_error_code(boost::system::errc::device_or_resource_busy);
+
+
+    class target
+    {
+    public: // --- state ---
+        stream_protocol::endpoint _peer;
+        std::optional<asio::ip::address> _source;
+        std::size_t _id;
+    public: // --- life ---
+        explicit target(stream_protocol::endpoint peer, std::optional<asio::ip::address> source, std::size_t id)
+            : _peer(std::move(peer)), _source(std::move(source)), _id(id)
+        { }
+    };
+
+    // single addresses or IPv4 networks in CIDR notation, without network and broadcast addresses
+    auto source_addresses(const std::vector<std::string>& specs, std::size_t limit) -> std::vector<asio::ip::address>
+    {
+        std::vector<asio::ip::address> result;
+        for (auto&& spec : specs) {
+            auto slash = spec.find('/');
+            if (spec.empty()) {
+                // ignore
+            } else if (slash == std::string::npos) {
+                result.push_back(asio::ip::address::from_string(spec));
+            } else {
+                auto prefix = std::stoul(spec.substr(slash + 1));
+                if (prefix > 32) {
+                    throw std::runtime_error("invalid-network");
+                }
+                std::uint64_t size = std::uint64_t(1) << (32 - prefix);
+                std::uint64_t base = asio::ip::address_v4::from_string(spec.substr(0, slash)).to_ulong() & ~(size - 1);
+                std::uint64_t first = size > 2 ? base + 1 : base;
+                std::uint64_t last = size > 2 ? base + size - 1 : base + size;
+                for (auto value = first; value != last && result.size() < limit; ++value) {
+                    result.push_back(asio::ip::address_v4(static_cast<std::uint32_t>(value)));
+                }
+            }
+        }
+        return result;
+    }
+
+
+    // uniform, fixed[:N], lognormal:M:S, pareto:A[:M] or file:PATH with lines of "size weight",
+    // sampled in advance so that drawing a size costs the same for all of them
+    class size_distribution
+    {
+    private: // --- scope ---
+        static constexpr std::size_t sample_count = 65536;
+    private: // --- state ---
+        std::vector<std::size_t> _samples;
+        std::uniform_int_distribution<std::size_t> _index;
+    public: // --- life ---
+        template <typename Random>
+        explicit size_distribution(std::string_view spec, std::size_t range, Random& random)
+            : _samples(sample_count), _index(0, sample_count - 1)
+        {
+            auto params = _split(spec);
+            auto&& name = params[0];
+            auto param = [&](std::size_t i, double default_value) {
+                return i < params.size() ? std::stod(params[i]) : default_value;
+            };
+            auto limit = double(range - 1);
+            auto sample = [&](auto&& dist) {
+                for (auto&& value : _samples) {
+                    value = static_cast<std::size_t>(std::clamp(dist(random), 0.0, limit));
+                }
+            };
+            if (name == "uniform") {
+                sample(std::uniform_real_distribution<double>(0, double(range)));
+            } else if (name == "fixed") {
+                std::fill(_samples.begin(), _samples.end(), static_cast<std::size_t>(std::clamp(param(1, limit), 0.0, limit)));
+            } else if (name == "lognormal" && params.size() == 3) {
+                auto median = param(1, 1), sigma = param(2, 1);
+                _check(median > 0 && sigma > 0);
+                sample(std::lognormal_distribution<double>(std::log(median), sigma));
+            } else if (name == "pareto" && params.size() >= 2) {
+                auto shape = param(1, 1), minimum = param(2, 1);
+                _check(shape > 0 && minimum > 0);
+                std::uniform_real_distribution<double> uniform(0, 1);
+                sample([&](auto& random) { return minimum / std::pow(1 - uniform(random), 1 / shape); });
+            } else if (name == "file" && params.size() == 2) {
+                auto histogram = _load(params[1]);
+                _check(std::all_of(histogram.second.begin(), histogram.second.end(), [](double w) { return w >= 0; })
+                    && std::accumulate(histogram.second.begin(), histogram.second.end(), 0.0) > 0);
+                std::discrete_distribution<std::size_t> dist(histogram.second.begin(), histogram.second.end());
+                sample([&](auto& random) { return histogram.first[dist(random)]; });
+            } else {
+                throw std::runtime_error("size-distribution-error");
+            }
+        }
+    public: // --- operations ---
+        template <typename Random>
+        auto operator()(Random& random) -> std::size_t
+        {
+            return _samples[index(random)];
+        }
+        // index of a random entry of samples()
+        template <typename Random>
+        auto index(Random& random) -> std::size_t
+        {
+            return _index(random);
+        }
+        auto samples() const -> const std::vector<std::size_t>& { return _samples; }
+    private:
+        static void _check(bool valid)
+        {
+            if (!valid) {
+                throw std::runtime_error("size-distribution-error");
+            }
+        }
+        static auto _split(std::string_view spec) -> std::vector<std::string>
+        {
+            std::vector<std::string> result;
+            for (;;) {
+                auto colon = std::min(spec.find(':'), spec.size());
+                result.emplace_back(spec.substr(0, colon));
+                if (colon == spec.size()) {
+                    return result;
+                }
+                spec.remove_prefix(colon + 1);
+            }
+        }
+        // sizes and weights of the histogram file
+        static auto _load(const std::string& path) -> std::pair<std::vector<double>, std::vector<double>>
+        {
+            std::ifstream in(path);
+            std::pair<std::vector<double>, std::vector<double>> result;
+            double size, weight;
+            while (in >> size >> weight) {
+                result.first.push_back(size);
+                result.second.push_back(weight);
+            }
+            if (!in.eof() || result.first.empty()) {
+                throw std::runtime_error("size-histogram-error");
+            }
+            return result;
+        }
+    };
+
+
     class chunk
     {
     private: // --- state ---
         char* _data;
         std::size_t _size;
+        std::size_t _response_size;
+        std::size_t _payload;
     public: // --- life ---
-        explicit chunk(char* data, std::size_t size)
-            : _data(data), _size(size)
+        explicit chunk(char* data, std::size_t size, std::size_t response_size, std::size_t payload)
+            : _data(data), _size(size), _response_size(response_size), _payload(payload)
         { }
     public: // --- operations ---
         auto data() { return _data; }
         auto size() { return _size; }
+        auto response_size() { return _response_size; }
+        auto payload() { return _payload; }
     };
 
 
     class chunker
     {
+    private: // --- scope ---
+        static constexpr std::size_t pool_memory = std::size_t(64) << 20;
     private: // --- state ---
         std::size_t _size;
         std::mt19937 _random;
-        std::uniform_int_distribution<std::size_t> _dist;
+        size_distribution _dist;
         std::unique_ptr<char[]> _data;
+        std::vector<chunk> _pool;
+        std::vector<std::uint32_t> _pool_index;
+        std::unique_ptr<char[]> _replay_data;
+        std::vector<chunk> _replay_pool;
     public: // --- life ---
-        explicit chunker(std::size_t size)
+        explicit chunker(std::size_t size, std::string_view protocol_name, std::string_view distribution, const capture_file* replay = nullptr)
             : _size(size)
             , _random(std::random_device()())
-            , _dist(0, _size - 1)
-            , _data(std::make_unique<char[]>(_size))
+            , _dist(distribution, _size, _random)
         {
-            auto dist = std::uniform_int_distribution<char>('A', 'Z');
-            for (std::size_t i = 0; i + 1 < _size; ++i) {
-                _data[i] = dist(_random);
+            if (protocol_name == protocol::line_reverse::name || protocol_name == protocol::echo::name) {
+                _data = std::make_unique<char[]>(_size);
+                auto dist = std::uniform_int_distribution<char>('A', 'Z');
+                for (std::size_t i = 0; i + 1 < _size; ++i) {
+                    _data[i] = dist(_random);
+                }
+                _data[_size - 1] = '\n';
+            } else {
+                protocol::with_protocol(protocol_name, [this,replay](auto protocol [[maybe_unused]]) {
+                        _make_pool<decltype(protocol)>();
+                        if (replay) {
+                            _make_replay_pool<decltype(protocol)>(*replay);
+                        }
+                    });
             }
-            _data[_size - 1] = '\n';
         }
     public: // --- operations ---
         auto operator()() -> chunk
         {
-            std::size_t offset = _dist(_random);
-            return chunk(_data.get() + offset, _size - offset);
+            if (_pool.empty()) {
+                return _suffix(_dist(_random));
+            } else {
+                return _pool[_pool_index[_dist.index(_random)]];
+            }
+        }
+        // request with the given payload size, limited to the size range
+        auto operator()(std::size_t payload) -> chunk
+        {
+            payload = std::min(payload, _size - 1);
+            if (_replay_pool.empty()) {
+                return _suffix(payload);
+            } else {
+                auto p = std::lower_bound(_replay_pool.begin(), _replay_pool.end(), payload,
+                    [](chunk lhs, std::size_t rhs) { return lhs.payload() < rhs; });
+                return p != _replay_pool.end() ? *p : _replay_pool.back();
+            }
+        }
+    private:
+        auto _suffix(std::size_t payload) -> chunk
+        {
+            std::size_t offset = _size - 1 - payload;
+            return chunk(_data.get() + offset, _size - offset, _size - offset, payload);
+        }
+        // requests for the distinct sizes of the samples, rounded to the
+        // smallest granularity that fits into the pool memory
+        template <typename Protocol>
+        void _make_pool()
+        {
+            std::vector<std::size_t> sizes(_dist.samples());
+            std::sort(sizes.begin(), sizes.end());
+            sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+            std::size_t granularity = 1;
+            std::vector<std::size_t> payloads;
+            for (;; granularity *= 2) {
+                payloads.clear();
+                std::size_t total = 0;
+                for (auto&& size : sizes) {
+                    auto payload = _round(size, granularity);
+                    if (payloads.empty() || payloads.back() != payload) {
+                        payloads.push_back(payload);
+                        total += Protocol::request_size(payload);
+                    }
+                }
+                if (total <= pool_memory || granularity >= _size) {
+                    break;
+                }
+            }
+            _make_requests<Protocol>(payloads, _data, _pool);
+            for (auto&& size : _dist.samples()) {
+                auto p = std::lower_bound(payloads.begin(), payloads.end(), _round(size, granularity));
+                _pool_index.push_back(static_cast<std::uint32_t>(p - payloads.begin()));
+            }
+        }
+        auto _round(std::size_t size, std::size_t granularity) const -> std::size_t
+        {
+            return std::min((size + granularity / 2) / granularity * granularity, _size - 1);
+        }
+        // requests for the distinct payload sizes, ordered by size
+        template <typename Protocol>
+        void _make_replay_pool(const capture_file& replay)
+        {
+            std::vector<std::size_t> payloads;
+            for (auto&& record : replay) {
+                payloads.push_back(std::min<std::size_t>(record._payload, _size - 1));
+            }
+            std::sort(payloads.begin(), payloads.end());
+            payloads.erase(std::unique(payloads.begin(), payloads.end()), payloads.end());
+            _make_requests<Protocol>(payloads, _replay_data, _replay_pool);
+        }
+        template <typename Protocol>
+        static void _make_requests(const std::vector<std::size_t>& payloads, std::unique_ptr<char[]>& storage, std::vector<chunk>& pool)
+        {
+            std::size_t total = 0;
+            for (auto&& payload : payloads) {
+                total += Protocol::request_size(payload);
+            }
+            storage = std::make_unique<char[]>(total);
+            auto data = storage.get();
+            for (auto&& payload : payloads) {
+                auto size = Protocol::request_size(payload);
+                Protocol::make_request(data, payload);
+                pool.emplace_back(data, size, Protocol::response_size(payload), payload);
+                data += size;
+            }
+        }
+    };
+
+
+    // FIFO queue in preallocated slots, which only grows once they are used up
+    template <typename Value>
+    class ring
+    {
+    private: // --- state ---
+        std::vector<std::optional<Value>> _slots;
+        std::size_t _head = 0;
+        std::size_t _size = 0;
+    public: // --- operations ---
+        bool empty() const { return _size == 0; }
+        void reserve(std::size_t capacity)
+        {
+            if (capacity > _slots.size()) {
+                _grow(capacity);
+            }
+        }
+        void push_back(Value value)
+        {
+            if (_size == _slots.size()) {
+                _grow(std::max<std::size_t>(2 * _slots.size(), 4));
+            }
+            _slots[(_head + _size) % _slots.size()].emplace(std::move(value));
+            ++_size;
+        }
+        auto pop_front() -> Value
+        {
+            auto&& slot = _slots[_head];
+            auto value = std::move(*slot);
+            slot.reset();
+            _head = (_head + 1) % _slots.size();
+            --_size;
+            return value;
+        }
+        void swap(ring& other)
+        {
+            _slots.swap(other._slots);
+            std::swap(_head, other._head);
+            std::swap(_size, other._size);
+        }
+    private:
+        void _grow(std::size_t capacity)
+        {
+            std::vector<std::optional<Value>> slots(capacity);
+            for (std::size_t i = 0; i != _size; ++i) {
+                slots[i] = std::move(_slots[(_head + i) % _slots.size()]);
+            }
+            _slots.swap(slots);
+            _head = 0;
         }
     };
 
 
+    // handler of the first request after a connect
+    class first_response
+    {
+    private: // --- state ---
+        steady_clock::time_point _connected;
+    public: // --- life ---
+        explicit first_response(steady_clock::time_point connected)
+            : _connected(connected)
+        { }
+    public: // --- operations ---
+        void operator()(error_code ec) const
+        {
+            if (!ec) {
+                global_connect_metrics.add(connect_metrics::first_response, steady_clock::now() - _connected);
+            }
+        }
+    };
+
+
+    template <typename Transport, typename Handler = std::function<void(error_code)>>
     class session
     {
     private: // --- scope ---
@@ -112,52 +640,109 @@ namespace
         {
         private: // --- state ---
             chunk _chunk;
-            std::function<void()> _handler;
+            Handler _handler;
         public: // --- life ---
-            template <typename Handler>
-            explicit request(chunk chunk, Handler&& handler)
-                : _chunk(chunk), _handler(std::forward<Handler>(handler))
+            template <typename Function>
+            explicit request(chunk chunk, Function&& handler)
+                : _chunk(chunk), _handler(std::forward<Function>(handler))
             { }
         public: // --- operations ---
             auto get_chunk() const { return _chunk; }
-            void done() const { _handler(); }
+            void done(error_code ec) const { _handler(ec); }
         };
-        using requests = std::list<request>;
+        using requests = ring<request>;
     private: // --- state ---
-        tcp::socket _socket;
-        tcp::endpoint _peer;
+        Transport _transport;
+        stream_protocol::endpoint _peer;
+        std::optional<asio::ip::address> _source;
+        std::size_t _id;
+        error_code _error;
         bool _send_lock = false;
         bool _recv_lock = false;
         requests _send_reqs;
         requests _recv_reqs;
+        std::vector<char> _response;
     public: // --- life ---
-        explicit session(asio::io_service& io_service, tcp::endpoint peer)
-            : _socket(io_service), _peer(std::move(peer))
+        explicit session(asio::io_service& io_service, const target& target)
+            : _transport(io_service), _peer(target._peer), _source(target._source), _id(target._id)
         { }
     public: // --- operations ---
-        template <typename Handler>
-        void async_connect(Handler&& handler)
+        auto id() const { return _id; }
+        // preallocates the slots of the queued requests
+        void reserve(std::size_t requests)
         {
-            _socket.async_connect(_peer, [this,handler=std::forward<Handler>(handler)](error_code ec) mutable {
-                    if (!ec) {
-                        _socket.set_option(tcp::no_delay(true));
-                    }
-                    handler(ec);
-                });
+            _send_reqs.reserve(requests);
+            _recv_reqs.reserve(requests);
         }
-        template <typename Handler>
-        void async_roundtrip(chunk chunk, Handler&& handler)
+        // the error that ended the session
+        auto error() const { return _error; }
+        bool failed() const { return bool(_error); }
+        template <typename Function>
+        void async_connect(Function&& handler)
+        {
+            if (_source) {
+                error_code ec;
+                _transport.bind(_peer, *_source, ec);
+                ABORT_ON_ERROR(ec, " action:bind");
+            }
+            _transport.async_connect(_peer, std::forward<Function>(handler));
+        }
+        // closes the socket of a failed connect before the next attempt
+        void close()
+        {
+            _transport.close();
+        }
+        // gives up on the connection after the last failed connect
+        void fail(error_code ec)
+        {
+            _error = ec;
+            close();
+        }
+        // closes the socket after the server has closed its side
+        template <typename Function>
+        void async_shutdown(Function&& handler)
+        {
+            error_code ec;
+            _transport.shutdown_send(ec);
+            if (ec) {
+                close();
+                handler(ec);
+                return;
+            }
+            _async_await_close(std::forward<Function>(handler));
+        }
+        // after an error, the queued requests complete with it and the socket is
+        // closed once no operation is in flight
+        template <typename Function>
+        void async_roundtrip(chunk chunk, Function&& handler)
         {
             _dispatch(_send_lock, _send_reqs, &session::_async_send,
-                request(chunk, std::forward<Handler>(handler)));
+                request(chunk, std::forward<Function>(handler)));
         }
     private:
+        template <typename Function>
+        void _async_await_close(Function&& handler)
+        {
+            _response.resize(std::max(_response.size(), std::size_t(64)));
+            _transport.async_read_some(_response.data(), _response.size(),
+                [this,handler=std::forward<Function>(handler)](error_code ec, std::size_t) mutable {
+                    if (ec) {
+                        close();
+                        handler(ec == asio::error::eof ? error_code() : ec);
+                    } else {
+                        _async_await_close(std::move(handler));
+                    }
+                });
+        }
         void _async_send(request req)
         {
             auto chunk = req.get_chunk();
-            async_write(_socket, asio::buffer(chunk.data(), chunk.size()),
+            _transport.async_write(chunk.data(), chunk.size(),
                 [this,req=std::move(req)](error_code ec, std::size_t) {
-                    ABORT_ON_ERROR(ec, " action:async-send");
+                    if (ec || _error) {
+                        _fail(ec, _send_lock, _send_reqs, std::move(req));
+                        return;
+                    }
                     _dequeue(_send_lock, _send_reqs, &session::_async_send);
                     _dispatch(_recv_lock, _recv_reqs, &session::_async_recv, std::move(req));
                 });
@@ -165,17 +750,47 @@ namespace
         void _async_recv(request req)
         {
             auto chunk = req.get_chunk();
-            async_read(_socket, asio::buffer(chunk.data(), chunk.size()),
-                [this,req=std::move(req)](error_code ec, std::size_t) {
-                    ABORT_ON_ERROR(ec, " action:async-recv");
+            _response.resize(std::max(_response.size(), chunk.response_size()));
+            _transport.async_read(_response.data(), chunk.response_size(),
+                [this,req=std::move(req)](error_code ec, std::size_t count) {
+                    if (_busy(count, req.get_chunk().response_size())) {
+                        ec = busy_error;
+                    }
+                    if (ec || _error) {
+                        _fail(ec, _recv_lock, _recv_reqs, std::move(req));
+                        return;
+                    }
                     _dequeue(_recv_lock, _recv_reqs, &session::_async_recv);
-                    req.done();
+                    req.done(ec);
                 });
         }
+        bool _busy(std::size_t count, std::size_t response_size) const
+        {
+            auto size = std::min(global_busy_response.size(), response_size);
+            return size != 0 && count >= size && std::string_view(_response.data(), size) == global_busy_response.substr(0, size);
+        }
+        void _fail(error_code ec, bool& lock, requests& reqs, request req)
+        {
+            if (!_error) {
+                _error = ec;
+                error_code ignored;
+                _transport.shutdown(ignored);
+            }
+            lock = false;
+            requests failed;
+            failed.swap(reqs);
+            if (!_send_lock && !_recv_lock) {
+                close();
+            }
+            req.done(_error);
+            while (!failed.empty()) {
+                failed.pop_front().done(_error);
+            }
+        }
         void _dispatch(bool& lock, requests& reqs, void (session::*handler)(request), request req)
         {
             if (lock) {
-                reqs.emplace_back(std::move(req));
+                reqs.push_back(std::move(req));
             } else {
                 lock = true;
                 (this->*handler)(std::move(req));
@@ -186,14 +801,13 @@ namespace
             if (reqs.empty()) {
                 lock = false;
             } else {
-                auto req = reqs.front();
-                reqs.pop_front();
-                (this->*handler)(std::move(req));
+                (this->*handler)(reqs.pop_front());
             }
         }
     };
 
 
+    template <typename Transport, typename Completion = std::function<void(error_code)>>
     class dispatcher
     {
     private: // --- scope ---
@@ -202,59 +816,161 @@ namespace
         {
         public: // --- state ---
             Handler _handler;
+            chunker& _chunker;
             std::size_t _index;
             std::size_t _pending = 0;
+            std::size_t _issued = 0;
+            bool _waiting = false;
+            steady_clock::time_point _start = steady_clock::now();
         public: // --- life ---
-            explicit connector(Handler handler, std::size_t index)
-                : _handler(std::move(handler)), _index(index)
+            explicit connector(Handler handler, chunker& chunker, std::size_t index)
+                : _handler(std::move(handler)), _chunker(chunker), _index(index)
             { }
         };
+        static constexpr milliseconds retry_delay = 10ms;
     private: // --- state ---
+        asio::io_service& _io_service;
+        asio::steady_timer _timer;
         std::mt19937 _random;
-        std::vector<session> _sessions;
+        std::vector<session<Transport, Completion>> _sessions;
+        std::vector<std::size_t> _live;
         std::size_t _bulk_connect;
+        double _connect_rate;
+        std::size_t _connect_retries;
     public: // --- life ---
         explicit dispatcher(
             asio::io_service& io_service,
-            const std::vector<tcp::endpoint>& endpoints,
-            std::size_t bulk_connect)
-            : _random(std::random_device()()), _bulk_connect(bulk_connect)
+            const std::vector<target>& targets,
+            std::size_t bulk_connect,
+            double connect_rate,
+            std::size_t connect_retries)
+            : _io_service(io_service)
+            , _timer(io_service)
+            , _random(std::random_device()())
+            , _bulk_connect(bulk_connect)
+            , _connect_rate(connect_rate)
+            , _connect_retries(connect_retries)
         {
-            _sessions.reserve(endpoints.size());
-            for (auto&& endpoint : endpoints) {
-                _sessions.emplace_back(io_service, endpoint);
+            _sessions.reserve(targets.size());
+            for (auto&& target : targets) {
+                _live.push_back(_sessions.size());
+                _sessions.emplace_back(io_service, target);
             }
         }
     public: // --- operations ---
+        // failed connects are retried with exponential backoff
         template <typename Handler>
-        void async_connect(Handler handler)
+        void async_connect(chunker& chunker, Handler handler)
         {
-            _async_connect_bulk(std::make_shared<connector<Handler>>(std::move(handler), _sessions.size()));
+            _async_connect_bulk(std::make_shared<connector<Handler>>(std::move(handler), chunker, _sessions.size()));
         }
+        auto size() const { return _sessions.size(); }
+        void reserve(std::size_t requests)
+        {
+            for (auto&& session : _sessions) {
+                session.reserve(requests);
+            }
+        }
+        // id of the first session, the others follow in order
+        auto first() const { return _sessions.empty() ? 0 : _sessions.front().id(); }
+        // failed sessions are dropped from the selection when they are drawn
         template <typename Handler>
         void async_roundtrip(chunk chunk, Handler&& handler)
         {
-            auto index = std::uniform_int_distribution<std::size_t>(0, _sessions.size() - 1)(_random);
-            _sessions[index].async_roundtrip(chunk, std::forward<Handler>(handler));
+            while (!_live.empty()) {
+                auto live = std::uniform_int_distribution<std::size_t>(0, _live.size() - 1)(_random);
+                auto index = _live[live];
+                if (!_sessions[index].failed()) {
+                    async_roundtrip(index, chunk, std::forward<Handler>(handler));
+                    return;
+                }
+                _live[live] = _live.back();
+                _live.pop_back();
+            }
+            _io_service.post([handler=std::forward<Handler>(handler)]() mutable { handler(asio::error::not_connected); });
+        }
+        // the handler of a request on a failed session gets its error
+        template <typename Handler>
+        void async_roundtrip(std::size_t index, chunk chunk, Handler&& handler)
+        {
+            auto&& session = _sessions[index];
+            if (session.failed()) {
+                _io_service.post([handler=std::forward<Handler>(handler),ec=session.error()]() mutable { handler(ec); });
+                return;
+            }
+            if (global_capture) {
+                global_capture->append(session.id(), chunk.payload());
+            }
+            session.async_roundtrip(chunk, std::forward<Handler>(handler));
         }
     private:
         template <typename Handler>
         void _async_connect_bulk(std::shared_ptr<connector<Handler>> connector)
         {
-            while (connector->_index > 0 && connector->_pending <= _bulk_connect) {
+            while (connector->_index > 0 && connector->_pending <= _bulk_connect && _due(*connector)) {
                 --connector->_index;
                 ++connector->_pending;
-                _sessions[connector->_index].async_connect(
-                    [this,connector](error_code ec) {
-                        ABORT_ON_ERROR(ec, " action:async-connect");
-                        --connector->_pending;
-                        _async_connect_bulk(connector);
-                    });
+                ++connector->_issued;
+                _async_connect_one(connector, connector->_index, 0);
             }
             if (connector->_index == 0 && connector->_pending == 0) {
                 connector->_handler();
+            } else if (connector->_index > 0 && connector->_pending <= _bulk_connect && !connector->_waiting) {
+                // wait for the next connect of the ramp
+                connector->_waiting = true;
+                _timer.expires_at(connector->_start + _ramp_offset(connector->_issued));
+                _timer.async_wait([this,connector](error_code ec) {
+                        ABORT_ON_ERROR(ec, " action:async-wait");
+                        connector->_waiting = false;
+                        _async_connect_bulk(connector);
+                    });
             }
         }
+        template <typename Handler>
+        void _async_connect_one(std::shared_ptr<connector<Handler>> connector, std::size_t index, std::size_t attempt)
+        {
+            global_connect_metrics.add(connect_metrics::attempts);
+            _sessions[index].async_connect(
+                [this,connector,index,attempt,start=steady_clock::now()](error_code ec) {
+                    if (ec && attempt < _connect_retries) {
+                        global_connect_metrics.add(connect_metrics::errors);
+                        _async_retry(std::move(connector), index, attempt + 1);
+                        return;
+                    } else if (ec) {
+                        global_connect_metrics.add(connect_metrics::errors);
+                        global_connect_metrics.add(connect_metrics::failures);
+                        _sessions[index].fail(ec);
+                    } else {
+                        auto now = steady_clock::now();
+                        global_connect_metrics.add(connect_metrics::connects);
+                        global_connect_metrics.add(connect_metrics::connect, now - start);
+                        if (_connect_rate > 0) {
+                            _sessions[index].async_roundtrip(connector->_chunker(), first_response(now));
+                        }
+                    }
+                    --connector->_pending;
+                    _async_connect_bulk(std::move(connector));
+                });
+        }
+        template <typename Handler>
+        void _async_retry(std::shared_ptr<connector<Handler>> connector, std::size_t index, std::size_t attempt)
+        {
+            _sessions[index].close();
+            auto timer = std::make_shared<asio::steady_timer>(_io_service, retry_delay * (1 << std::min<std::size_t>(attempt - 1, 7)));
+            timer->async_wait([this,connector=std::move(connector),index,attempt,timer](error_code ec) {
+                    ABORT_ON_ERROR(ec, " action:async-wait");
+                    _async_connect_one(std::move(connector), index, attempt);
+                });
+        }
+        template <typename Connector>
+        bool _due(const Connector& connector) const
+        {
+            return _connect_rate <= 0 || steady_clock::now() >= connector._start + _ramp_offset(connector._issued);
+        }
+        auto _ramp_offset(std::size_t issued) const -> steady_clock::duration
+        {
+            return std::chrono::duration_cast<steady_clock::duration>(duration(double(issued) / _connect_rate));
+        }
     };
 
 
@@ -351,6 +1067,8 @@ namespace
             while (to >= _watermark) {
                 auto ratio = duration(_watermark - from) / duration(to - from);
                 _record.add(current.split(ratio));
+                // pending requests and their latency, where the servers print sessions and p99
+                std::unique_lock<std::mutex> lock(output_mutex);
                 std::cout << "STATUS: "
                           << std::chrono::duration_cast<seconds>(to.time_since_epoch()).count()
                           << " "
@@ -406,6 +1124,7 @@ namespace
             , _threshold(threshold)
         { }
     public: // --- operations ---
+        void rate(double rps) { _rps = rps; }
         auto initiated(time_point now) -> duration
         {
             auto interval = 1.0s / _rps;
@@ -416,6 +1135,13 @@ namespace
             }
             return interval;
         }
+        // a request that ended with an error instead of a response
+        void failed(time_point now, duration elapsed, error_code ec)
+        {
+            _pending._count -= 1;
+            _pending._duration -= now - elapsed - _base;
+            global_request_metrics.add(ec == busy_error ? request_metrics::rejected : request_metrics::failed);
+        }
         void completed(time_point now, duration elapsed)
         {
             _pending._count -= 1;
@@ -436,46 +1162,312 @@ namespace
     };
 
 
-    class driver : public std::enable_shared_from_this<driver>
+    // lagging threads hand a part of their rate to the threads with a low
+    // lag, and take it back once their own lag has been low for a period
+    class rate_balancer
     {
+    private: // --- scope ---
+        using self = rate_balancer;
+        static constexpr microseconds lag_threshold = 1000us;
+        static constexpr microseconds recovery_threshold = 250us;
+        static constexpr milliseconds period = 1000ms;
+        static constexpr double transfer = 0.1;
     private: // --- state ---
-        asio::system_timer _timer;
-        dispatcher _dispatcher;
+        std::mutex _mutex;
+        std::vector<double> _shares;
+        std::vector<double> _rates;
+        std::vector<std::optional<microseconds>> _lags;
+        std::atomic<std::uint64_t> _generation{0};
+        steady_clock::time_point _next = steady_clock::now() + period;
+    public: // --- life ---
+        explicit rate_balancer(std::vector<double> rates)
+            : _shares(rates), _rates(std::move(rates)), _lags(_rates.size())
+        { }
+        rate_balancer(const self& rhs) = delete;
+        rate_balancer(self&& rhs) noexcept = delete;
+        ~rate_balancer() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        // reports the mean lateness of a thread since its previous report
+        void report(std::size_t index, microseconds lag)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _lags[index] = std::max(_lags[index].value_or(0us), lag);
+            auto now = steady_clock::now();
+            if (now >= _next) {
+                _next = now + period;
+                _rebalance();
+                _lags.assign(_lags.size(), std::nullopt);
+            }
+        }
+        // changes whenever the rates change
+        auto generation() const -> std::uint64_t
+        {
+            return _generation.load(std::memory_order_acquire);
+        }
+        auto rate(std::size_t index) -> double
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _rates[index];
+        }
+    private:
+        bool _lagging(std::size_t i) const { return _lags[i] && *_lags[i] > lag_threshold; }
+        bool _recovered(std::size_t i) const { return _lags[i] && *_lags[i] < recovery_threshold; }
+        void _rebalance()
+        {
+            // lag between the thresholds, or no report at all, keeps the rate
+            double pool = 0, demand = 0, excess = 0, receiving = 0;
+            std::size_t receivers = 0;
+            for (std::size_t i = 0; i != _rates.size(); ++i) {
+                if (_lagging(i)) {
+                    pool += _rates[i] * transfer;
+                } else if (_rates[i] > _shares[i]) {
+                    excess += _rates[i] - _shares[i];
+                }
+                if (_recovered(i)) {
+                    demand += _demand(i, _rates[i]);
+                    receiving += _rates[i];
+                    ++receivers;
+                }
+            }
+            if (receivers == 0 || (pool == 0 && demand == 0)) {
+                return;
+            }
+            // the recovered threads take back their share first, from the
+            // lagging threads and then from the threads above their share
+            auto from_excess = std::min(std::max(demand - pool, 0.0), excess);
+            auto supply = pool + from_excess;
+            auto returned = std::min(demand, supply);
+            auto rest = supply - returned;
+            auto rates = _rates;
+            for (std::size_t i = 0; i != _rates.size(); ++i) {
+                if (_lagging(i)) {
+                    _rates[i] -= rates[i] * transfer;
+                } else if (rates[i] > _shares[i] && excess > 0) {
+                    _rates[i] -= from_excess * (rates[i] - _shares[i]) / excess;
+                }
+                if (_recovered(i)) {
+                    _rates[i] += demand > 0 ? returned * _demand(i, rates[i]) / demand : 0;
+                    _rates[i] += receiving > 0 ? rest * rates[i] / receiving : rest / double(receivers);
+                }
+            }
+            _generation.fetch_add(1, std::memory_order_release);
+            auto now = std::chrono::duration_cast<seconds>(clock::now().time_since_epoch());
+            std::unique_lock<std::mutex> lock(output_mutex);
+            std::cout << "BALANCE: " << now.count();
+            for (auto&& rate : _rates) {
+                std::cout << " " << static_cast<std::size_t>(rate);
+            }
+            std::cout << std::endl;
+        }
+        // the share a recovered thread takes back per period
+        auto _demand(std::size_t i, double rate) const -> double
+        {
+            return std::min(_shares[i] * transfer, std::max(_shares[i] - rate, 0.0));
+        }
+    };
+
+
+    // with a positive spin time, the driver wakes up earlier and busy-waits for the arrival
+    class pacing
+    {
+    private: // --- state ---
+        bool _poisson;
+        steady_clock::duration _spin;
+        std::mt19937 _random;
+        std::exponential_distribution<double> _exponential{1.0};
+        std::optional<std::pair<steady_clock::time_point, steady_clock::time_point>> _previous;
+    public: // --- life ---
+        explicit pacing(std::string_view arrivals, microseconds spin)
+            : _spin(spin), _random(std::random_device()())
+        {
+            if (arrivals == "uniform") {
+                _poisson = false;
+            } else if (arrivals == "poisson") {
+                _poisson = true;
+            } else {
+                throw std::runtime_error("arrivals-error");
+            }
+        }
+    public: // --- operations ---
+        auto spin() const { return _spin; }
+        auto interval(duration mean) -> steady_clock::duration
+        {
+            return std::chrono::duration_cast<steady_clock::duration>(_poisson ? mean * _exponential(_random) : mean);
+        }
+        // busy-waits until the given time, if it is within the spin time
+        auto wait(steady_clock::time_point until) const -> steady_clock::time_point
+        {
+            auto now = steady_clock::now();
+            while (now < until && until - now <= _spin) {
+                now = steady_clock::now();
+            }
+            return now;
+        }
+        // records the start of a request at now that was due at the given time
+        void started(steady_clock::time_point due, steady_clock::time_point now)
+        {
+            global_pacing_metrics.add(pacing_metrics::requests);
+            global_pacing_metrics.add(pacing_metrics::lateness, now - due);
+            if (_previous) {
+                global_pacing_metrics.add(pacing_metrics::intended, due - _previous->first);
+                global_pacing_metrics.add(pacing_metrics::achieved, now - _previous->second);
+            }
+            _previous.emplace(due, now);
+        }
+    };
+
+
+    template <typename Transport>
+    class driver : public std::enable_shared_from_this<driver<Transport>>
+    {
+    private: // --- state ---
+        asio::steady_timer _timer;
+        dispatcher<Transport> _dispatcher;
         scheduler _scheduler;
         chunker _chunker;
-        time_point _watermark;
+        pacing _pacing;
+        steady_clock::time_point _watermark;
+        std::shared_ptr<rate_balancer> _balancer;
+        std::size_t _index;
+        steady_clock::time_point _report;
+        steady_clock::duration _lateness{};
+        std::size_t _requests = 0;
+        std::uint64_t _generation = 0;
     public: // --- life ---
         explicit driver(
             asio::io_service& io_service,
-            const std::vector<tcp::endpoint>& endpoints,
+            const std::vector<target>& targets,
             std::size_t bulk_connect,
+            double connect_rate,
+            std::size_t connect_retries,
             scheduler scheduler,
-            chunker chunker)
+            chunker chunker,
+            pacing pacing,
+            std::shared_ptr<rate_balancer> balancer,
+            std::size_t index)
             : _timer(io_service)
-            , _dispatcher(io_service, endpoints, bulk_connect)
+            , _dispatcher(io_service, targets, bulk_connect, connect_rate, connect_retries)
             , _scheduler(std::move(scheduler))
             , _chunker(std::move(chunker))
+            , _pacing(std::move(pacing))
+            , _balancer(std::move(balancer))
+            , _index(index)
         { }
     public: // --- operations ---
         void async_run()
         {
-            auto self = shared_from_this();
-            _dispatcher.async_connect([this,self=std::move(self)] {
-                    _watermark = clock::now();
+            auto self = this->shared_from_this();
+            _dispatcher.async_connect(_chunker, [this,self=std::move(self)] {
+                    _watermark = steady_clock::now();
+                    _report = _watermark;
                     _async_run(std::move(self));
                 });
         }
     private:
         void _async_run(std::shared_ptr<driver> self)
         {
+            auto now = _pacing.wait(_watermark);
             auto horizon = clock::now();
-            while (_watermark <= horizon) {
-                _dispatcher.async_roundtrip(_chunker(), [this,self,start=horizon] {
+            if (_balancer) {
+                _rebalance(now);
+            }
+            while (_watermark <= now) {
+                _pacing.started(_watermark, now);
+                _lateness += now - _watermark;
+                ++_requests;
+                _dispatcher.async_roundtrip(_chunker(), [this,self,start=horizon](error_code ec) {
                         auto now = clock::now();
-                        _scheduler.completed(now, now - start);
+                        if (ec) {
+                            _scheduler.failed(now, now - start, ec);
+                        } else {
+                            _scheduler.completed(now, now - start);
+                        }
                     });
-                _watermark += std::chrono::duration_cast<clock::duration>(
-                    _scheduler.initiated(horizon));
+                _watermark += _pacing.interval(_scheduler.initiated(horizon));
+            }
+            _timer.expires_at(_watermark - _pacing.spin());
+            _timer.async_wait([this,self=std::move(self)](error_code ec) {
+                    ABORT_ON_ERROR(ec, "async-wait");
+                    _async_run(std::move(self));
+                });
+        }
+        // reports the lateness every 100ms, and takes over a new rate
+        // before the next send
+        void _rebalance(steady_clock::time_point now)
+        {
+            if (now - _report >= 100ms) {
+                auto lag = _requests ? _lateness / static_cast<steady_clock::rep>(_requests) : steady_clock::duration();
+                _balancer->report(_index, std::chrono::duration_cast<microseconds>(lag));
+                _report = now;
+                _lateness = {};
+                _requests = 0;
+            }
+            if (auto generation = _balancer->generation(); generation != _generation) {
+                _generation = generation;
+                _scheduler.rate(_balancer->rate(_index));
+            }
+        }
+    };
+
+
+    // a new connection for every few requests
+    template <typename Transport>
+    class churn_driver : public std::enable_shared_from_this<churn_driver<Transport>>
+    {
+    private: // --- scope ---
+        class cycle
+        {
+        public: // --- state ---
+            session<Transport> _session;
+            std::size_t _remaining;
+            steady_clock::time_point _connected;
+        public: // --- life ---
+            explicit cycle(asio::io_service& io_service, const target& target, std::size_t requests)
+                : _session(io_service, target), _remaining(requests)
+            { }
+        };
+    private: // --- state ---
+        asio::io_service& _io_service;
+        asio::system_timer _timer;
+        std::vector<target> _targets;
+        std::size_t _next = 0;
+        std::size_t _requests;
+        duration _interval;
+        scheduler _scheduler;
+        chunker _chunker;
+        time_point _watermark;
+    public: // --- life ---
+        explicit churn_driver(
+            asio::io_service& io_service,
+            std::vector<target> targets,
+            std::size_t requests,
+            double rps,
+            scheduler scheduler,
+            chunker chunker)
+            : _io_service(io_service)
+            , _timer(io_service)
+            , _targets(std::move(targets))
+            , _requests(requests)
+            , _interval(double(requests) / rps)
+            , _scheduler(std::move(scheduler))
+            , _chunker(std::move(chunker))
+        { }
+    public: // --- operations ---
+        void async_run()
+        {
+            _watermark = clock::now();
+            _async_run(this->shared_from_this());
+        }
+    private:
+        void _async_run(std::shared_ptr<churn_driver> self)
+        {
+            auto horizon = clock::now();
+            while (_watermark <= horizon) {
+                _async_connect(self, std::make_shared<cycle>(_io_service, _targets[_next], _requests));
+                _next = (_next + 1) % _targets.size();
+                _watermark += std::chrono::duration_cast<clock::duration>(_interval);
             }
             _timer.expires_at(_watermark);
             _timer.async_wait([this,self=std::move(self)](error_code ec) {
@@ -483,6 +1475,299 @@ namespace
                     _async_run(std::move(self));
                 });
         }
+        void _async_connect(std::shared_ptr<churn_driver> self, std::shared_ptr<cycle> cycle)
+        {
+            global_churn_metrics.add(churn_metrics::cycles);
+            cycle->_session.async_connect([this,self=std::move(self),cycle,start=steady_clock::now()](error_code ec) {
+                    if (ec) {
+                        global_churn_metrics.add(churn_metrics::errors);
+                        return;
+                    }
+                    cycle->_connected = steady_clock::now();
+                    global_churn_metrics.add(churn_metrics::connect, cycle->_connected - start);
+                    _async_roundtrip(self, cycle);
+                });
+        }
+        void _async_roundtrip(std::shared_ptr<churn_driver> self, std::shared_ptr<cycle> cycle)
+        {
+            auto start = clock::now();
+            _scheduler.initiated(start);
+            cycle->_session.async_roundtrip(_chunker(), [this,self,cycle,start](error_code ec) {
+                    auto now = clock::now();
+                    if (ec) {
+                        _scheduler.failed(now, now - start, ec);
+                        global_churn_metrics.add(churn_metrics::errors);
+                        return;
+                    }
+                    _scheduler.completed(now, now - start);
+                    if (cycle->_remaining-- == _requests) {
+                        global_churn_metrics.add(churn_metrics::first_response, steady_clock::now() - cycle->_connected);
+                    }
+                    if (cycle->_remaining != 0) {
+                        _async_roundtrip(self, cycle);
+                    } else {
+                        cycle->_session.async_shutdown([cycle,start=steady_clock::now()](error_code ec) {
+                                if (ec) {
+                                    global_churn_metrics.add(churn_metrics::errors);
+                                } else {
+                                    global_churn_metrics.add(churn_metrics::close, steady_clock::now() - start);
+                                    global_churn_metrics.add(churn_metrics::completed);
+                                }
+                            });
+                    }
+                });
+        }
+    };
+
+
+    template <typename Transport>
+    class closed_loop_driver : public std::enable_shared_from_this<closed_loop_driver<Transport>>
+    {
+    private: // --- state ---
+        dispatcher<Transport> _dispatcher;
+        scheduler _scheduler;
+        chunker _chunker;
+        std::size_t _outstanding;
+        microseconds _think_time;
+        std::vector<asio::steady_timer> _timers;
+    public: // --- life ---
+        explicit closed_loop_driver(
+            asio::io_service& io_service,
+            const std::vector<target>& targets,
+            std::size_t bulk_connect,
+            double connect_rate,
+            std::size_t connect_retries,
+            std::size_t outstanding,
+            microseconds think_time,
+            scheduler scheduler,
+            chunker chunker)
+            : _dispatcher(io_service, targets, bulk_connect, connect_rate, connect_retries)
+            , _scheduler(std::move(scheduler))
+            , _chunker(std::move(chunker))
+            , _outstanding(outstanding)
+            , _think_time(think_time)
+        {
+            if (_think_time.count() > 0) {
+                _timers.reserve(_dispatcher.size() * _outstanding);
+                for (std::size_t slot = 0; slot != _dispatcher.size() * _outstanding; ++slot) {
+                    _timers.emplace_back(io_service);
+                }
+            }
+        }
+    public: // --- operations ---
+        void async_run()
+        {
+            auto self = this->shared_from_this();
+            _dispatcher.async_connect(_chunker, [this,self=std::move(self)] {
+                    for (std::size_t slot = 0; slot != _dispatcher.size() * _outstanding; ++slot) {
+                        _async_roundtrip(self, slot);
+                    }
+                });
+        }
+    private:
+        void _async_roundtrip(std::shared_ptr<closed_loop_driver> self, std::size_t slot)
+        {
+            auto start = clock::now();
+            _scheduler.initiated(start);
+            _dispatcher.async_roundtrip(slot / _outstanding, _chunker(), [this,self,slot,start](error_code ec) {
+                    auto now = clock::now();
+                    if (ec) {
+                        // the slot ends with its session
+                        _scheduler.failed(now, now - start, ec);
+                        return;
+                    }
+                    _scheduler.completed(now, now - start);
+                    if (_timers.empty()) {
+                        _async_roundtrip(self, slot);
+                    } else {
+                        _timers[slot].expires_from_now(_think_time);
+                        _timers[slot].async_wait([this,self,slot](error_code ec) {
+                                ABORT_ON_ERROR(ec, " action:async-wait");
+                                _async_roundtrip(self, slot);
+                            });
+                    }
+                });
+        }
+    };
+
+
+    // the last thread to finish its connects sets the start time
+    class replay_start
+    {
+    private: // --- scope ---
+        using self = replay_start;
+    private: // --- state ---
+        std::atomic<std::size_t> _pending;
+        std::atomic<steady_clock::rep> _start{0};
+    public: // --- life ---
+        explicit replay_start(std::size_t threads)
+            : _pending(threads)
+        { }
+        replay_start(const self& rhs) = delete;
+        replay_start(self&& rhs) noexcept = delete;
+        ~replay_start() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        void arrive()
+        {
+            if (_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                _start.store(steady_clock::now().time_since_epoch().count(), std::memory_order_release);
+            }
+        }
+        auto get() const -> std::optional<steady_clock::time_point>
+        {
+            auto start = _start.load(std::memory_order_acquire);
+            if (start == 0) {
+                return std::nullopt;
+            }
+            return steady_clock::time_point(steady_clock::duration(start));
+        }
+    };
+
+
+    // handler of a replayed request, stored in its slot without type erasure
+    template <typename Driver>
+    class replay_completion
+    {
+    private: // --- state ---
+        std::shared_ptr<Driver> _driver;
+        time_point _start;
+        std::optional<first_response> _first;
+    public: // --- life ---
+        explicit replay_completion(std::shared_ptr<Driver> driver, time_point start)
+            : _driver(std::move(driver)), _start(start)
+        { }
+        explicit replay_completion(first_response first)
+            : _first(first)
+        { }
+    public: // --- operations ---
+        void operator()(error_code ec) const
+        {
+            if (_driver) {
+                _driver->completed(ec, _start);
+            } else {
+                (*_first)(ec);
+            }
+        }
+    };
+
+
+    // each thread sends the records of its connections at their offsets divided by the speed
+    template <typename Transport>
+    class replay_driver : public std::enable_shared_from_this<replay_driver<Transport>>
+    {
+    private: // --- scope ---
+        using completion = replay_completion<replay_driver>;
+        static constexpr std::size_t default_outstanding = 16;
+    private: // --- state ---
+        asio::steady_timer _timer;
+        dispatcher<Transport, completion> _dispatcher;
+        scheduler _scheduler;
+        chunker _chunker;
+        pacing _pacing;
+        const capture_file& _file;
+        replay_start& _start;
+        std::size_t _connections;
+        double _speed;
+        const capture_record* _next;
+        steady_clock::time_point _base;
+    public: // --- life ---
+        explicit replay_driver(
+            asio::io_service& io_service,
+            const std::vector<target>& targets,
+            std::size_t bulk_connect,
+            double connect_rate,
+            std::size_t connect_retries,
+            scheduler scheduler,
+            chunker chunker,
+            pacing pacing,
+            const capture_file& file,
+            replay_start& start,
+            std::size_t connections,
+            std::size_t outstanding,
+            double speed)
+            : _timer(io_service)
+            , _dispatcher(io_service, targets, bulk_connect, connect_rate, connect_retries)
+            , _scheduler(std::move(scheduler))
+            , _chunker(std::move(chunker))
+            , _pacing(std::move(pacing))
+            , _file(file)
+            , _start(start)
+            , _connections(connections)
+            , _speed(speed)
+            , _next(file.begin())
+        {
+            // the captured connections that share a session queue their requests together
+            auto shared = (std::max<std::size_t>(file.header()._connections, 1) + connections - 1) / connections;
+            _dispatcher.reserve((outstanding ? outstanding : default_outstanding) * shared);
+        }
+    public: // --- operations ---
+        void async_run()
+        {
+            auto self = this->shared_from_this();
+            _dispatcher.async_connect(_chunker, [this,self=std::move(self)] {
+                    _start.arrive();
+                    _async_start(std::move(self));
+                });
+        }
+        void completed(error_code ec, time_point start)
+        {
+            auto now = clock::now();
+            if (ec) {
+                _scheduler.failed(now, now - start, ec);
+            } else {
+                _scheduler.completed(now, now - start);
+            }
+        }
+    private:
+        void _async_start(std::shared_ptr<replay_driver> self)
+        {
+            if (auto start = _start.get()) {
+                _base = *start;
+                _async_run(std::move(self));
+                return;
+            }
+            _timer.expires_from_now(1ms);
+            _timer.async_wait([this,self=std::move(self)](error_code ec) {
+                    ABORT_ON_ERROR(ec, " action:async-wait");
+                    _async_start(std::move(self));
+                });
+        }
+        void _async_run(std::shared_ptr<replay_driver> self)
+        {
+            auto now = _pacing.wait(_due());
+            auto horizon = clock::now();
+            for (; _next != _file.end(); ++_next) {
+                auto connection = _next->_connection % _connections;
+                if (connection < _dispatcher.first() || connection - _dispatcher.first() >= _dispatcher.size()) {
+                    continue;
+                }
+                auto due = _due();
+                if (due > now) {
+                    break;
+                }
+                _pacing.started(due, now);
+                _scheduler.initiated(horizon);
+                _dispatcher.async_roundtrip(connection - _dispatcher.first(), _chunker(_next->_payload), completion(self, horizon));
+            }
+            if (_next == _file.end()) {
+                return;
+            }
+            _timer.expires_at(_due() - _pacing.spin());
+            _timer.async_wait([this,self=std::move(self)](error_code ec) {
+                    ABORT_ON_ERROR(ec, " action:async-wait");
+                    _async_run(std::move(self));
+                });
+        }
+        auto _due() const -> steady_clock::time_point
+        {
+            if (_next == _file.end()) {
+                return _base;
+            }
+            auto offset = nanoseconds(_next->_ns - _file.begin()->_ns);
+            return _base + std::chrono::duration_cast<steady_clock::duration>(offset / _speed);
+        }
     };
 
 }
@@ -493,13 +1778,28 @@ int main(int argc, char* argv[])
         std::ios::sync_with_stdio(false);
         // command line arguments
         std::string addr = "127.0.0.1";
-        std::vector<unsigned short> ports{9999};
+        std::vector<std::string> ports{"9999"};
         std::size_t connections = 100;
         std::size_t rps = 1000;
         std::size_t range = 100;
         std::vector<int> cpus(std::thread::hardware_concurrency());
         std::iota(cpus.begin(), cpus.end(), 0);
         std::size_t bulk_connect = SOMAXCONN;
+        std::string protocol_name{protocol::line_reverse::name};
+        std::vector<std::string> local_addrs;
+        std::size_t connect_rate = 0;
+        std::size_t connect_retries = 0;
+        std::string distribution = "uniform";
+        std::size_t outstanding = 0;
+        std::size_t think_time = 0;
+        std::size_t churn_requests = 0;
+        std::string arrivals = "uniform";
+        std::size_t spin_us = 0;
+        bool rebalance = false;
+        std::string capture;
+        std::string replay;
+        std::size_t replay_speed = 100;
+        std::string backend_name = "asio";
         parse_command_line(std::cout, argc - 1, argv + 1,
             "remote-addr", addr,
             "remote-ports", ports,
@@ -507,34 +1807,119 @@ int main(int argc, char* argv[])
             "requests-per-second", rps,
             "message-size-range", range,
             "cpu-set", cpus,
-            "bulk-connect", bulk_connect);
+            "bulk-connect", bulk_connect,
+            "protocol", protocol_name,
+            "local-addrs", local_addrs,
+            "connect-rate", connect_rate,
+            "connect-retries", connect_retries,
+            "size-distribution", distribution,
+            "outstanding", outstanding,
+            "think-time-us", think_time,
+            "churn-requests", churn_requests,
+            "arrivals", arrivals,
+            "spin-us", spin_us,
+            "rebalance", rebalance,
+            "capture", capture,
+            "replay", replay,
+            "replay-speed-percent", replay_speed,
+            "io-backend", backend_name);
         // run
+        auto backend = parse_io_backend(backend_name);
+        protocol::with_protocol(protocol_name, [](auto protocol [[maybe_unused]]) {
+            global_busy_response = decltype(protocol)::busy;
+        });
         auto address = asio::ip::address::from_string(addr);
-        std::vector<tcp::endpoint> endpoints;
+        auto sources = source_addresses(local_addrs, connections);
+        std::vector<target> targets;
         for (std::size_t i = 0; i != connections; ++i) {
-            endpoints.emplace_back(address, ports[i % ports.size()]);
+            auto&& port = ports[i % ports.size()];
+            if (is_unix_address(port)) {
+                targets.emplace_back(asio::local::stream_protocol::endpoint(unix_path(port)), std::nullopt, i);
+            } else if (sources.empty()) {
+                targets.emplace_back(tcp::endpoint(address, tcp_port(port)), std::nullopt, i);
+            } else {
+                targets.emplace_back(tcp::endpoint(address, tcp_port(port)), sources[i % sources.size()], i);
+            }
+        }
+        if (!capture.empty()) {
+            global_capture = std::make_unique<capture_writer>(capture, connections);
         }
+        if (!replay.empty() && arrivals != "uniform") {
+            // the replay keeps the arrivals of the capture
+            throw std::runtime_error("replay-arrivals-error");
+        }
+        if (churn_requests != 0 && rps < cpus.size()) {
+            // every thread starts its cycles at a positive rate
+            throw std::runtime_error("churn-rate-error");
+        }
+        auto replay_file = replay.empty() ? nullptr : std::make_unique<capture_file>(replay);
+        if (replay_file && replay_file->header()._connections != connections) {
+            // the records are mapped onto the connections modulo their number
+            log("WARN: connections of the capture: ", replay_file->header()._connections);
+        }
+        auto start = std::make_shared<replay_start>(cpus.size());
         auto&& rps_ = partitioner(rps, cpus.size());
         auto&& connections_ = partitioner(connections, cpus.size());
         auto&& bulk_connect_ = partitioner(bulk_connect, cpus.size());
         time_point watermark = clock::now();
         auto controller = std::make_shared<class controller>(cpus.size(), watermark);
+        std::vector<double> rates;
+        for (std::size_t i = 0; i != cpus.size(); ++i) {
+            rates.push_back(double(rps_()));
+        }
+        auto balancer = rebalance ? std::make_shared<rate_balancer>(rates) : nullptr;
+        std::thread([] {
+                for (;;) {
+                    auto now = std::chrono::duration_cast<seconds>(clock::now().time_since_epoch());
+                    auto next = now + 5s - now % 5s;
+                    std::this_thread::sleep_until(time_point(next));
+                    global_connect_metrics.print(std::cout, next.count());
+                    global_churn_metrics.print(std::cout, next.count());
+                    global_pacing_metrics.print(std::cout, next.count());
+                    global_request_metrics.print(std::cout, next.count());
+                    if (global_capture) {
+                        auto count = global_capture->flush();
+                        std::unique_lock<std::mutex> lock(output_mutex);
+                        std::cout << "CAPTURE: " << next.count() << " " << count << std::endl;
+                    }
+                }
+            }).detach();
         std::vector<std::thread> threads;
-        for (auto&& cpu : cpus) {
-            auto q = endpoints.end(), p = q - static_cast<ptrdiff_t>(connections_());
+        for (std::size_t index = 0; index != cpus.size(); ++index) {
+            auto q = targets.end(), p = q - static_cast<ptrdiff_t>(connections_());
             threads.emplace_back(
-                [cpu,endpoints=std::vector<tcp::endpoint>(p, q),range,watermark,controller,rps=rps_(),bulk_connect=bulk_connect_()] {
+                [index,cpu=cpus[index],targets=std::vector<target>(p, q),watermark,controller,balancer,rps=rates[index],bulk_connect=bulk_connect_(),connect_rate=double(connect_rate)/double(cpus.size()),connect_retries,outstanding,think_time,churn_requests,&replay_file,start,connections,speed=double(replay_speed)/100,backend,chunker=chunker(range, protocol_name, distribution, replay_file.get()),pacing=pacing(arrivals, microseconds(spin_us))]() mutable {
                     thread_affinity({cpu});
-                    auto threshold = static_cast<int>(endpoints.size());
+                    auto threshold = static_cast<int>(targets.size());
                     asio::io_service io_service;
-                    std::make_shared<driver>(io_service, endpoints, bulk_connect, scheduler(controller, watermark, rps, threshold), chunker(range))->async_run();
-                    io_service.run();
+                    try {
+                        with_io_backend(backend, [&](auto tag) {
+                                using transport = typename decltype(tag)::transport;
+                                transport::prepare(io_service, targets.size());
+                                if (replay_file) {
+                                    std::make_shared<replay_driver<transport>>(io_service, targets, bulk_connect, connect_rate, connect_retries, scheduler(controller, watermark, rps, threshold), std::move(chunker), std::move(pacing), *replay_file, *start, connections, outstanding, speed)->async_run();
+                                } else if (churn_requests != 0) {
+                                    std::make_shared<churn_driver<transport>>(io_service, std::move(targets), churn_requests, rps, scheduler(controller, watermark, rps, threshold), std::move(chunker))->async_run();
+                                } else if (outstanding == 0) {
+                                    std::make_shared<driver<transport>>(io_service, targets, bulk_connect, connect_rate, connect_retries, scheduler(controller, watermark, rps, threshold), std::move(chunker), std::move(pacing), balancer, index)->async_run();
+                                } else {
+                                    std::make_shared<closed_loop_driver<transport>>(io_service, targets, bulk_connect, connect_rate, connect_retries, outstanding, microseconds(think_time), scheduler(controller, watermark, rps, threshold), std::move(chunker))->async_run();
+                                }
+                            });
+                        io_service.run();
+                    } catch (const std::exception& e) {
+                        std::cerr << "ERROR: " << e.what() << "\n";
+                        std::exit(EXIT_FAILURE);
+                    }
                 });
-            endpoints.erase(p, q);
+            targets.erase(p, q);
         }
         for (auto&& thread : threads) {
             thread.join();
         }
+        if (global_capture) {
+            global_capture->flush();
+        }
     } catch (std::exception& e) {
         std::cerr << "ERROR: " << e.what() << "\n";
         return EXIT_FAILURE;
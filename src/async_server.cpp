@@ -1,12 +1,28 @@
+#include <atomic>
+#include <cerrno>
 #include <iostream>
 #include <numeric>
+#include <optional>
+#include <type_traits>
+
+#include <sys/sendfile.h>
+#include <sys/socket.h>
 
 #include "boost/asio/steady_timer.hpp"
 
+#include "address.hpp"
+#include "admission.hpp"
 #include "buffer.hpp"
 #include "command_line.hpp"
 #include "io_service_executor.hpp"
 #include "log.hpp"
+#include "memory.hpp"
+#include "metrics.hpp"
+#include "party.hpp"
+#include "protocol.hpp"
+#include "trace.hpp"
+#include "work.hpp"
+#include "zerocopy.hpp"
 
 namespace
 {
@@ -14,49 +30,92 @@ namespace
     using namespace std::chrono_literals;
     using namespace demo;
     using error_code = boost::system::error_code;
+    // TCP or Unix domain sockets
+    using stream_protocol = asio::generic::stream_protocol;
+
+    // removes a stale socket file of a previous run
+    auto listen_endpoint(const std::string& address) -> stream_protocol::endpoint
+    {
+        if (is_unix_address(address)) {
+            auto path = unix_path(address);
+            unix_unlink(path);
+            return asio::local::stream_protocol::endpoint(path);
+        } else {
+            return asio::ip::tcp::endpoint(asio::ip::tcp::v4(), tcp_port(address));
+        }
+    }
 
 
+    template <bool Strands>
     class stream
     {
     private: // --- state ---
-        asio::ip::tcp::socket _socket;
-        asio::ip::tcp::endpoint _peer;
+        stream_protocol::socket _socket;
+        stream_protocol::endpoint _peer;
         buffer _buffer;
         asio::steady_timer _timer;
-        bool _timeout = false;
+        std::atomic<bool> _timeout{false};
+        bool _shared;
+        std::size_t _zerocopy_threshold;
+        zerocopy_tracker _zerocopy_tracker;
+        std::optional<asio::io_service::strand> _strand;
     public: // --- life ---
-        explicit stream(asio::ip::tcp::socket socket, asio::ip::tcp::endpoint peer)
+        explicit stream(stream_protocol::socket socket, stream_protocol::endpoint peer, std::size_t zerocopy_threshold, bool shared)
             : _socket(std::move(socket)), _peer(std::move(peer)), _timer(_socket.get_io_service())
+            , _shared(shared && !Strands), _zerocopy_threshold(zerocopy_threshold)
         {
-            _socket.set_option(asio::ip::tcp::no_delay(true));
+            if constexpr (Strands) {
+                _strand.emplace(_socket.get_io_service());
+            }
+            if (_peer.protocol().family() != AF_UNIX) {
+                _socket.set_option(asio::ip::tcp::no_delay(true));
+            }
+            if (_zerocopy_threshold && !enable_zerocopy(_socket.native_handle())) {
+                _zerocopy_threshold = 0;
+            }
         }
     public: // --- operations ---
         auto data() { return _buffer.data(); }
         auto available() const { return _buffer.available(); }
         void drain(std::size_t n) { _buffer.drain(n); }
         bool timeout() const { return _timeout; }
+        template <typename Handler>
+        void post(Handler handler)
+        {
+            if constexpr (Strands) {
+                _strand->post(std::move(handler));
+            } else {
+                _socket.get_io_service().post(std::move(handler));
+            }
+        }
         void expires_from_now(const asio::steady_timer::duration& duration, std::shared_ptr<void> owner)
         {
             _timer.expires_from_now(duration);
-            _timer.async_wait(
+            _timer.async_wait(_bind(
                 [this,owner=std::move(owner)](error_code ec) mutable {
                     if (ec == asio::error::operation_aborted) {
                         // ignore
                     } else if (ec) {
                         log("WARN: timer error: ", ec);
+                    } else if (_shared) {
+                        // a handler of the session may run on another thread, so the
+                        // pending operation is only woken up by the kernel
+                        _timeout = true;
+                        ::shutdown(_socket.native_handle(), SHUT_RDWR);
                     } else {
                         _timeout = true;
                         _socket.cancel();
                     }
-                });
+                }));
         }
-        template <typename Handler>
-        void async_getline(Handler handler, std::size_t offset = 0)
+        template <typename Protocol, typename Handler>
+        void async_read_request(Protocol& protocol, Handler handler, std::size_t offset = 0)
         {
-            auto p = _buffer.data(), q = p + _buffer.available();
-            auto r = std::find(p + offset, q, '\n');
-            if (r != q) {
-                handler(error_code(), static_cast<std::size_t>(r - p) + 1);
+            auto size = protocol.frame(_buffer.data(), _buffer.available(), offset);
+            if (size == protocol::invalid) {
+                handler(asio::error::invalid_argument, _buffer.available());
+            } else if (size != protocol::incomplete) {
+                handler(error_code(), size);
             } else {
                 try {
                     _buffer.reserve(1500);
@@ -64,22 +123,39 @@ namespace
                     handler(boost::asio::error::no_memory, _buffer.available());
                     return;
                 }
+                DEMO_TRACE_EVENT(read, begin, this, _buffer.available());
                 _socket.async_read_some(
                     asio::buffer(_buffer.next(), _buffer.reserve()),
-                    [this,handler=std::move(handler)](error_code ec, std::size_t count) mutable {
+                    _bind([this,&protocol,handler=std::move(handler)](error_code ec, std::size_t count) mutable {
+                        DEMO_TRACE_EVENT(read, end, this, count);
                         if (ec) {
                             handler(ec, _buffer.available());
                         } else {
+                            global_server_metrics.add(server_metrics::bytes_in, count);
                             _buffer.advance(count);
-                            async_getline(std::move(handler), _buffer.available() - count);
+                            async_read_request(protocol, std::move(handler), _buffer.available() - count);
                         }
-                    });
+                    }));
             }
         }
         template <typename Handler>
+        void async_write_response(const protocol::response& response, Handler handler)
+        {
+            if (response._fd != -1) {
+                _async_sendfile(response._fd, response._offset, response._size, 0, std::move(handler));
+            } else {
+                async_write_n(response._data, response._size, std::move(handler));
+            }
+        }
+        // with zerocopy, the handler is invoked once the kernel has released the pages
+        template <typename Handler>
         void async_write_n(const char* data, std::size_t size, Handler handler)
         {
-            async_write(_socket, asio::buffer(data, size), std::move(handler));
+            if (_zerocopy_threshold && size >= _zerocopy_threshold) {
+                _async_send_zerocopy(data, size, 0, std::move(handler));
+            } else {
+                async_write(_socket, asio::buffer(data, size), _bind(std::move(handler)));
+            }
         }
         bool good(error_code ec)
         {
@@ -92,52 +168,240 @@ namespace
             }
             _timer.cancel();
         }
+    private:
+        template <typename Handler>
+        auto _bind(Handler&& handler)
+        {
+            if constexpr (Strands) {
+                return asio::bind_executor(*_strand, memory_counted(std::forward<Handler>(handler)));
+            } else {
+                return memory_counted(std::forward<Handler>(handler));
+            }
+        }
+        template <typename Handler>
+        void _async_sendfile(int fd, std::size_t offset, std::size_t size, std::size_t sent, Handler handler)
+        {
+            error_code ec;
+            _socket.non_blocking(true, ec);
+            while (!ec && sent != size) {
+                auto position = static_cast<off_t>(offset + sent);
+                ssize_t rv = ::sendfile(_socket.native_handle(), fd, &position, size - sent);
+                if (rv != -1) {
+                    sent += static_cast<std::size_t>(rv);
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    _socket.async_wait(asio::socket_base::wait_write,
+                        _bind([this,fd,offset,size,sent,handler=std::move(handler)](error_code ec2) mutable {
+                            if (ec2) {
+                                handler(ec2, sent);
+                            } else {
+                                _async_sendfile(fd, offset, size, sent, std::move(handler));
+                            }
+                        }));
+                    return;
+                } else if (errno != EINTR) {
+                    ec = error_code(errno, asio::error::get_system_category());
+                }
+            }
+            // not inline: a pipelined read may complete inline as well
+            post([ec,sent,handler=std::move(handler)]() mutable { handler(ec, sent); });
+        }
+        template <typename Handler>
+        void _async_send_zerocopy(const char* data, std::size_t size, std::size_t offset, Handler handler)
+        {
+            _socket.async_send(
+                asio::buffer(data + offset, size - offset), MSG_ZEROCOPY,
+                _bind([this,data,size,offset,handler=std::move(handler)](error_code ec, std::size_t count) mutable {
+                    if (ec == asio::error::no_buffer_space) {
+                        // optmem limit reached: fall back to copying
+                        async_write(_socket, asio::buffer(data + offset, size - offset),
+                            _bind([this,size,handler=std::move(handler)](error_code ec2, std::size_t) mutable {
+                                if (ec2) {
+                                    handler(ec2, size);
+                                } else {
+                                    _async_await_zerocopy(size, std::move(handler));
+                                }
+                            }));
+                    } else if (ec) {
+                        handler(ec, offset);
+                    } else {
+                        _zerocopy_tracker.sent();
+                        if (offset + count < size) {
+                            _async_send_zerocopy(data, size, offset + count, std::move(handler));
+                        } else {
+                            _async_await_zerocopy(size, std::move(handler));
+                        }
+                    }
+                }));
+        }
+        template <typename Handler>
+        void _async_await_zerocopy(std::size_t size, Handler handler)
+        {
+            if (!_zerocopy_tracker.poll(_socket.native_handle())) {
+                handler(asio::error::fault, size);
+            } else if (!_zerocopy_tracker.pending()) {
+                handler(error_code(), size);
+            } else {
+                _socket.async_wait(asio::socket_base::wait_error,
+                    _bind([this,size,handler=std::move(handler)](error_code ec) mutable {
+                        if (ec) {
+                            handler(ec, size);
+                        } else {
+                            _async_await_zerocopy(size, std::move(handler));
+                        }
+                    }));
+            }
+        }
     };
 
 
-    class session : public std::enable_shared_from_this<session>
+    // threads for simulated work that would block the io_service_executor
+    class offload_pool
     {
+    private: // --- scope ---
+        using self = offload_pool;
     private: // --- state ---
-        stream _stream;
+        asio::io_service _io_service;
+        asio::io_service::work _guard;
+        std::vector<std::thread> _threads;
+        std::atomic<std::size_t> _queued{0};
     public: // --- life ---
-        explicit session(asio::ip::tcp::socket socket, asio::ip::tcp::endpoint peer)
-            : _stream(std::move(socket), std::move(peer))
-        { }
+        explicit offload_pool(std::size_t size)
+            : _guard(_io_service)
+        {
+            for (std::size_t i = 0; i != size; ++i) {
+                _threads.emplace_back([this] { _io_service.run(); });
+            }
+        }
+        offload_pool(const self& rhs) = delete;
+        offload_pool(self&& rhs) noexcept = delete;
+        ~offload_pool() noexcept
+        {
+            _io_service.stop();
+            for (auto&& thread : _threads) {
+                thread.join();
+            }
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto size() const { return _threads.size(); }
+        auto queued() const { return _queued.load(std::memory_order_relaxed); }
+        template <typename Handler>
+        void post(Handler handler)
+        {
+            _queued.fetch_add(1, std::memory_order_relaxed);
+            _io_service.post([this,handler=std::move(handler)]() mutable {
+                    _queued.fetch_sub(1, std::memory_order_relaxed);
+                    handler();
+                });
+        }
+    };
+
+
+    template <typename Protocol, bool Strands>
+    class session : public std::enable_shared_from_this<session<Protocol, Strands>>
+    {
+    private: // --- state ---
+        stream<Strands> _stream;
+        Protocol _protocol;
+        party& _party;
+        const simulated_work& _work;
+        offload_pool& _offload;
+        admission& _admission;
+    public: // --- life ---
+        explicit session(stream_protocol::socket socket, stream_protocol::endpoint peer, std::size_t zerocopy_threshold, bool shared, party& party, const simulated_work& work, offload_pool& offload, admission& admission)
+            : _stream(std::move(socket), std::move(peer), zerocopy_threshold, shared), _party(party), _work(work), _offload(offload), _admission(admission)
+        {
+            global_server_metrics.add(server_metrics::sessions);
+            memory_add(memory_category::sessions, sizeof(*this));
+        }
+        ~session() noexcept
+        {
+            _admission.release();
+            memory_sub(memory_category::sessions, sizeof(*this));
+            global_server_metrics.sub(server_metrics::sessions);
+        }
     public: // --- operations ---
         void start()
         {
-            _async_run(shared_from_this());
+            _async_run(this->shared_from_this());
         }
     private:
         void _async_run(std::shared_ptr<session> self)
         {
             _stream.expires_from_now(300s, self);
-            _stream.async_getline(
+            DEMO_TRACE_EVENT(request, begin, &_stream, 0);
+            _stream.async_read_request(_protocol,
                 [this,self=std::move(self)](error_code ec, std::size_t length) mutable {
-                    if (_stream.good(ec)) {
-                        auto data = _stream.data();
-                        std::reverse(data, data + length - 1);
-                        _stream.async_write_n(data, length,
-                            [this,self=std::move(self)](error_code ec2, std::size_t length2) mutable {
-                                if (_stream.good(ec2)) {
-                                    _stream.drain(length2);
-                                    _async_run(std::move(self));
-                                } else {
-                                    _handle_error(ec2, "sending data to client");
-                                }
+                    DEMO_TRACE_EVENT(request, end, &_stream, length);
+                    if (!_stream.good(ec)) {
+                        _handle_error(ec, "receiving request from client");
+                    } else if (_party.size()) {
+                        _party.async_await([this,self=std::move(self),length]() mutable {
+                                _stream.post([this,self=std::move(self),length]() mutable {
+                                        _async_work(std::move(self), length);
+                                    });
+                            });
+                    } else {
+                        _async_work(std::move(self), length);
+                    }
+                });
+        }
+        // sheds the request with the busy response if the queue of the pool is beyond the limit
+        void _async_work(std::shared_ptr<session> self, std::size_t length)
+        {
+            auto start = std::chrono::steady_clock::now();
+            DEMO_TRACE_EVENT(process, begin, &_stream, length);
+            if (_work.empty() || _offload.size() == 0) {
+                _work(_stream.data(), length);
+                _async_respond(std::move(self), length, start);
+            } else if (!_admission.admits_request(_offload.queued())) {
+                DEMO_TRACE_EVENT(process, end, &_stream, 0);
+                global_server_metrics.add(server_metrics::shed);
+                _stream.async_write_n(Protocol::busy.data(), Protocol::busy.size(),
+                    [this,self=std::move(self)](error_code, std::size_t) mutable {
+                        _stream.release();
+                    });
+            } else {
+                _offload.post([this,self=std::move(self),length,start]() mutable {
+                        _work(_stream.data(), length);
+                        _stream.post([this,self=std::move(self),length,start]() mutable {
+                                _async_respond(std::move(self), length, start);
                             });
+                    });
+            }
+        }
+        void _async_respond(std::shared_ptr<session> self, std::size_t length, std::chrono::steady_clock::time_point start)
+        {
+            auto response = _protocol.process(_stream.data(), length);
+            DEMO_TRACE_EVENT(process, end, &_stream, response._size);
+            DEMO_TRACE_EVENT(write, begin, &_stream, response._size);
+            _stream.async_write_response(response,
+                [this,self=std::move(self),start,length](error_code ec, std::size_t length2) mutable {
+                    DEMO_TRACE_EVENT(write, end, &_stream, length2);
+                    if (_stream.good(ec)) {
+                        global_server_metrics.add(server_metrics::requests);
+                        global_server_metrics.add(server_metrics::bytes_out, length2);
+                        global_server_metrics.latency(std::chrono::steady_clock::now() - start);
+                        _stream.drain(length);
+                        _async_run(std::move(self));
                     } else {
-                        _handle_error(ec, "receiving line from client");
+                        _handle_error(ec, "sending data to client");
                     }
                 });
         }
         void _handle_error(error_code ec, const char* operation)
         {
             if (_stream.timeout()) {
+                global_server_metrics.add(server_metrics::timeouts);
                 log("WARN: operation timeout: ", operation);
+            } else if (ec == asio::error::invalid_argument) {
+                global_server_metrics.add(server_metrics::protocol_errors);
+                log("WARN: protocol violation");
             } else if (ec != asio::error::eof) {
                 log("WARN: operation error: ", operation);
             } else if (_stream.available()) {
+                global_server_metrics.add(server_metrics::protocol_errors);
                 log("WARN: protocol violation");
             } else {
                 // eof
@@ -147,37 +411,213 @@ namespace
     };
 
 
+    template <typename Protocol, bool Strands>
     class server
     {
     private: // --- state ---
         io_service_executor& _executor;
-        asio::ip::tcp::acceptor _acceptor;
-        asio::ip::tcp::socket _socket;
-        asio::ip::tcp::endpoint _peer;
+        asio::basic_socket_acceptor<stream_protocol> _acceptor;
+        std::optional<asio::io_service::strand> _strand;
+        std::size_t _zerocopy_threshold;
+        party& _party;
+        const simulated_work& _work;
+        offload_pool& _offload;
+        admission& _admission;
+        std::size_t _accept_batch;
     public: // --- life ---
-        explicit server(io_service_executor& executor, unsigned short port)
+        explicit server(
+            io_service_executor& executor,
+            const std::string& address,
+            std::size_t zerocopy_threshold,
+            party& party,
+            const simulated_work& work,
+            offload_pool& offload,
+            admission& admission,
+            std::size_t accept_batch,
+            std::size_t accept_depth)
             : _executor(executor)
-            , _acceptor(executor.get_io_service(), asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
-            , _socket(_executor.get_io_service())
+            , _acceptor(executor.get_io_service(), listen_endpoint(address))
+            , _zerocopy_threshold(zerocopy_threshold)
+            , _party(party)
+            , _work(work)
+            , _offload(offload)
+            , _admission(admission)
+            , _accept_batch(std::max<std::size_t>(accept_batch, 1))
         {
-            _async_accept();
+            _acceptor.non_blocking(true);
+            if (_executor.shared()) {
+                // the accept handlers of a shared io_service may run concurrently
+                _strand.emplace(executor.get_io_service());
+            }
+            for (std::size_t i = 0; i != std::max<std::size_t>(accept_depth, 1); ++i) {
+                _async_accept();
+            }
         }
     private:
+        // drains up to a batch of pending connections per readiness event
         void _async_accept()
         {
-            _acceptor.async_accept(_socket, _peer, [this](error_code ec) {
-                    asio::ip::tcp::socket socket(std::move(_socket));
-                    _socket = asio::ip::tcp::socket(_executor.get_io_service());
-                    asio::ip::tcp::endpoint peer = std::move(_peer);
+            auto handler = [this](error_code ec) {
+                if (ec) {
+                    log("WARN: socket accept failed: ", ec);
                     _async_accept();
+                } else if (_accept_some()) {
+                    _async_accept();
+                } else {
+                    _async_resume();
+                }
+            };
+            if (_strand) {
+                _acceptor.async_wait(stream_protocol::socket::wait_read, asio::bind_executor(*_strand, handler));
+            } else {
+                _acceptor.async_wait(stream_protocol::socket::wait_read, handler);
+            }
+        }
+        // resumes accepting on the io_service, once a session has ended
+        void _async_resume()
+        {
+            _admission.async_await_connection([this] {
+                    if (_strand) {
+                        _strand->post([this] { _async_accept(); });
+                    } else {
+                        _acceptor.get_io_service().post([this] { _async_accept(); });
+                    }
+                });
+        }
+        // returns false, if accepting is paused at the connection limit
+        bool _accept_some()
+        {
+            auto reserved = _admission.policy() == overload_policy::pause;
+            for (std::size_t i = 0; i != _accept_batch; ) {
+                if (reserved && !_admission.reserve()) {
+                    return false;
+                }
+                sockaddr_storage address;
+                socklen_t length = sizeof(address);
+                int fd = ::accept4(_acceptor.native_handle(), reinterpret_cast<sockaddr*>(&address), &length, SOCK_CLOEXEC);
+                if (fd == -1) {
+                    if (reserved) {
+                        _admission.release();
+                    }
+                    if (errno == EINTR || errno == ECONNABORTED) {
+                        continue;
+                    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        log("WARN: socket accept failed: ", errno);
+                    }
+                    return true;
+                }
+                ++i;
+                if (!reserved && !_admission.reserve()) {
+                    admission::refuse(fd, Protocol::busy);
+                    ::close(fd);
+                    global_server_metrics.add(server_metrics::rejects);
+                    continue;
+                }
+                stream_protocol::endpoint peer(&address, length);
+                stream_protocol::socket socket(_executor.get_io_service());
+                error_code ec;
+                socket.assign(peer.protocol(), fd, ec);
+                if (ec) {
+                    ::close(fd);
+                    _admission.release();
+                    log("WARN: socket assign failed: ", ec);
+                    continue;
+                }
+                global_server_metrics.add(server_metrics::accepts);
+                DEMO_TRACE_EVENT(accept, instant, this, socket.native_handle());
+                if (_executor.numa_aware()) {
+                    _start_on_node(std::move(socket), std::move(peer));
+                } else {
+                    _start(std::move(socket), std::move(peer));
+                }
+            }
+            return true;
+        }
+        // the session is created on the thread of that node, so it is allocated from local memory
+        void _start_on_node(stream_protocol::socket socket, stream_protocol::endpoint peer)
+        {
+            auto&& io_service = _executor.get_io_service(get_incoming_cpu(socket.native_handle()));
+            if (&io_service != &socket.get_io_service()) {
+                int fd = ::dup(socket.native_handle());
+                if (fd == -1) {
+                    _admission.release();
+                    log("WARN: socket dup failed: ", errno);
+                    return;
+                }
+                stream_protocol::socket moved(io_service);
+                error_code ec;
+                moved.assign(peer.protocol(), fd, ec);
+                if (ec) {
+                    ::close(fd);
+                    _admission.release();
+                    log("WARN: socket assign failed: ", ec);
+                    return;
+                }
+                socket = std::move(moved);
+            }
+            std::shared_ptr<stream_protocol::socket> shared;
+            try {
+                shared = std::make_shared<stream_protocol::socket>(std::move(socket));
+            } catch (const std::bad_alloc& e) {
+                _admission.release();
+                log("WARN: session create failed: ", e.what());
+                return;
+            }
+            io_service.post([this,shared=std::move(shared),peer=std::move(peer)]() mutable {
+                    _start(std::move(*shared), std::move(peer));
+                });
+        }
+        void _start(stream_protocol::socket socket, stream_protocol::endpoint peer)
+        {
+            auto busy_poll = _executor.busy_poll();
+            if (busy_poll.count() && !set_busy_poll(socket.native_handle(), busy_poll)) {
+                log("WARN: socket busy-poll failed");
+            }
+            try {
+                std::make_shared<session<Protocol, Strands>>(std::move(socket), std::move(peer), _zerocopy_threshold, _executor.shared(), _party, _work, _offload, _admission)->start();
+            } catch (const std::bad_alloc& e) {
+                _admission.release();
+                log("WARN: session create failed: ", e.what());
+            }
+        }
+    };
+
+
+    class reporter
+    {
+    private: // --- state ---
+        io_service_executor& _executor;
+        party& _party;
+        asio::steady_timer _timer;
+    public: // --- life ---
+        explicit reporter(io_service_executor& executor, party& party)
+            : _executor(executor), _party(party), _timer(executor.get_io_service())
+        {
+            _async_wait();
+        }
+    private:
+        void _async_wait()
+        {
+            _timer.expires_from_now(5s);
+            _timer.async_wait([this](error_code ec) {
                     if (ec) {
-                        log("WARN: socket accept failed: ", ec);
+                        log("WARN: timer error: ", ec);
                     } else {
-                        try {
-                            std::make_shared<session>(std::move(socket), std::move(peer))->start();
-                        } catch (const std::bad_alloc& e) {
-                            log("WARN: session create failed: ", e.what());
+                        auto now = std::chrono::system_clock::now().time_since_epoch();
+                        auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(now).count();
+                        global_server_metrics.print(std::cout, timestamp);
+                        trace_flush(std::cout, timestamp);
+                        memory_flush(std::cout, timestamp, global_server_metrics.value(server_metrics::sessions));
+                        if (_executor.numa_aware()) {
+                            _executor.placement().print(std::cout, timestamp);
+                        }
+                        if (_executor.busy_poll().count()) {
+                            global_busy_poll_stats.print(std::cout, timestamp);
                         }
+                        if (_party.size()) {
+                            _party.print(std::cout, timestamp);
+                        }
+                        _async_wait();
                     }
                 });
         }
@@ -190,20 +630,64 @@ int main(int argc, char* argv[])
     try {
         std::ios::sync_with_stdio(false);
         // command line arguments
-        std::vector<unsigned short> ports{9999};
+        std::vector<std::string> addresses{"9999"};
         std::vector<int> cpus(std::thread::hardware_concurrency());
         std::iota(cpus.begin(), cpus.end(), 0);
+        bool numa_aware = false;
+        std::size_t busy_poll_us = 0;
+        std::size_t zerocopy_threshold = 10240;
+        std::string protocol_name{protocol::line_reverse::name};
+        std::size_t party_size = 0;
+        std::string work_spec;
+        std::size_t offload_threads = 0;
+        std::size_t accept_batch = 1;
+        std::size_t accept_depth = 1;
+        std::string topology = "per-core";
+        std::size_t max_connections = 0;
+        std::size_t max_queued = 0;
+        std::string policy = "pause";
         parse_command_line(std::cout, argc - 1, argv + 1,
-            "local-ports", ports,
-            "cpu-set", cpus);
+            "local-ports", addresses,
+            "cpu-set", cpus,
+            "numa-aware", numa_aware,
+            "busy-poll-us", busy_poll_us,
+            "zerocopy-threshold", zerocopy_threshold,
+            "protocol", protocol_name,
+            "party-size", party_size,
+            "work", work_spec,
+            "offload-threads", offload_threads,
+            "accept-batch", accept_batch,
+            "accept-depth", accept_depth,
+            "executor", topology,
+            "max-connections", max_connections,
+            "max-queued", max_queued,
+            "overload-policy", policy);
         // run
-        io_service_executor executor(cpus);
-        std::vector<server> servers;
-        servers.reserve(ports.size());
-        for (auto&& port : ports) {
-            servers.emplace_back(executor, port);
+        if (protocol::uses_payload_store(protocol_name)) {
+            create_global_payload_store();
         }
-        executor.run();
+        io_service_executor executor(cpus, numa_aware, std::chrono::microseconds(busy_poll_us), parse_executor_topology(topology));
+        party party(party_size);
+        simulated_work work(work_spec);
+        offload_pool offload(offload_threads);
+        admission admission(max_connections, max_queued, parse_overload_policy(policy));
+        protocol::with_protocol(protocol_name, [&](auto protocol [[maybe_unused]]) {
+            using protocol_type = decltype(protocol);
+            auto run = [&](auto strands) {
+                std::vector<server<protocol_type, decltype(strands)::value>> servers;
+                servers.reserve(addresses.size());
+                for (auto&& address : addresses) {
+                    servers.emplace_back(executor, address, zerocopy_threshold, party, work, offload, admission, accept_batch, accept_depth);
+                }
+                reporter reporter(executor, party);
+                executor.run();
+            };
+            if (executor.strands()) {
+                run(std::true_type());
+            } else {
+                run(std::false_type());
+            }
+        });
     } catch (std::exception& e) {
         std::cerr << "ERROR: " << e.what() << "\n";
         return EXIT_FAILURE;
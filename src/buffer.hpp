@@ -3,6 +3,8 @@
 #include <algorithm>
 #include <cstdlib>
 
+#include "memory.hpp"
+
 namespace demo
 {
 
@@ -21,6 +23,7 @@ namespace demo
         buffer(self&& rhs) noexcept = delete;
         ~buffer() noexcept
         {
+            memory_sub(memory_category::buffers, _capacity);
             std::free(_data);
         }
     public: // --- operations ---
@@ -60,6 +63,7 @@ namespace demo
             if (_size > _capacity / 2) {
                 capacity = std::max(capacity, _bias + _size + required);
                 if (auto data = static_cast<char*>(std::realloc(_data, capacity))) {
+                    memory_add(memory_category::buffers, capacity - _capacity);
                     _data = data;
                     _capacity = capacity;
                 } else {
@@ -70,8 +74,10 @@ namespace demo
                 if (auto data = static_cast<char*>(std::malloc(capacity))) {
                     std::copy_n(_data + _bias, _size, data);
                     std::free(_data);
+                    memory_add(memory_category::buffers, capacity - _capacity);
                     _data = data;
                     _capacity = capacity;
+                    _bias = 0;
                 } else {
                     throw std::bad_alloc();
                 }
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+namespace demo
+{
+
+    // false if the kernel rejects the option, e.g. without CAP_NET_ADMIN
+    inline bool set_busy_poll(int fd, std::chrono::microseconds budget)
+    {
+        int usecs = static_cast<int>(budget.count());
+        int prefer = 1;
+        return ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) == 0
+            && ::setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) == 0;
+    }
+
+
+    // hits and misses of the spin budget, together with the CPU time of the process
+    class busy_poll_stats
+    {
+    private: // --- scope ---
+        using self = busy_poll_stats;
+        using steady_clock = std::chrono::steady_clock;
+        struct snapshot
+        {
+            std::size_t _hits = 0;
+            std::size_t _misses = 0;
+            std::chrono::microseconds _user{0};
+            std::chrono::microseconds _system{0};
+            steady_clock::time_point _time = steady_clock::now();
+        };
+    private: // --- state ---
+        alignas(64) std::atomic<std::size_t> _hits{0};
+        alignas(64) std::atomic<std::size_t> _misses{0};
+        alignas(64) snapshot _previous;
+    public: // --- operations ---
+        void hit() { _hits.fetch_add(1, std::memory_order_relaxed); }
+        void miss() { _misses.fetch_add(1, std::memory_order_relaxed); }
+        void print(std::ostream& os, long long timestamp)
+        {
+            snapshot current;
+            current._hits = _hits.load(std::memory_order_relaxed);
+            current._misses = _misses.load(std::memory_order_relaxed);
+            rusage usage;
+            if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+                current._user = _to_duration(usage.ru_utime);
+                current._system = _to_duration(usage.ru_stime);
+            }
+            auto elapsed = std::chrono::duration<double>(current._time - _previous._time).count();
+            auto percent = [elapsed](std::chrono::microseconds cpu) {
+                return static_cast<std::size_t>(elapsed > 0 ? 100 * std::chrono::duration<double>(cpu).count() / elapsed : 0);
+            };
+            os << "BUSYPOLL: " << timestamp
+               << " " << current._hits - _previous._hits
+               << " " << current._misses - _previous._misses
+               << " " << percent(current._user - _previous._user)
+               << " " << percent(current._system - _previous._system)
+               << std::endl;
+            _previous = current;
+        }
+    private:
+        static auto _to_duration(const timeval& tv) -> std::chrono::microseconds
+        {
+            return std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec);
+        }
+    };
+
+    inline busy_poll_stats global_busy_poll_stats;
+
+}
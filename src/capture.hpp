@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a capture file is a header and a record for every request in the order of their start
+
+namespace demo
+{
+
+    // on-disk layout of a single request
+    struct capture_record
+    {
+        std::uint64_t _ns; // since the start of the capture
+        std::uint32_t _connection;
+        std::uint32_t _payload;
+    };
+    static_assert(sizeof(capture_record) == 16);
+
+    // on-disk header in front of the records
+    struct capture_header
+    {
+        static constexpr std::uint32_t magic = 0x50414344; // "DCAP"
+        std::uint32_t _magic;
+        std::uint32_t _connections;
+    };
+    static_assert(sizeof(capture_header) == 8);
+
+
+    // each thread appends to its own buffer, which the flush swaps out
+    class capture_writer
+    {
+    private: // --- scope ---
+        using self = capture_writer;
+        using steady_clock = std::chrono::steady_clock;
+        struct alignas(64) buffer
+        {
+            std::mutex _mutex;
+            std::vector<capture_record> _records;
+        };
+    private: // --- state ---
+        std::mutex _mutex;
+        std::mutex _flush_mutex;
+        std::vector<std::shared_ptr<buffer>> _buffers;
+        std::vector<capture_record> _swapped;
+        std::vector<capture_record> _writing;
+        steady_clock::time_point _start = steady_clock::now();
+        std::FILE* _file;
+    public: // --- life ---
+        explicit capture_writer(const std::string& path, std::size_t connections)
+            : _file(std::fopen(path.c_str(), "wb"))
+        {
+            capture_header header{capture_header::magic, static_cast<std::uint32_t>(connections)};
+            if (!_file) {
+                throw std::runtime_error("capture-open-error");
+            } else if (std::fwrite(&header, sizeof(header), 1, _file) != 1) {
+                std::fclose(_file);
+                throw std::runtime_error("capture-write-error");
+            }
+        }
+        capture_writer(const self& rhs) = delete;
+        capture_writer(self&& rhs) noexcept = delete;
+        ~capture_writer() noexcept
+        {
+            std::fclose(_file);
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        void append(std::size_t connection, std::size_t payload)
+        {
+            auto&& local = _local();
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now() - _start).count();
+            std::unique_lock<std::mutex> lock(local._mutex);
+            local._records.push_back(capture_record{
+                static_cast<std::uint64_t>(ns),
+                static_cast<std::uint32_t>(connection),
+                static_cast<std::uint32_t>(payload)});
+        }
+        // writes the records since the previous call and returns their number
+        auto flush() -> std::size_t
+        {
+            std::unique_lock<std::mutex> flush_lock(_flush_mutex);
+            std::vector<std::shared_ptr<buffer>> buffers;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                buffers = _buffers;
+            }
+            for (auto&& buffer : buffers) {
+                {
+                    // hands the thread an emptied vector that keeps its capacity
+                    std::unique_lock<std::mutex> lock(buffer->_mutex);
+                    swap(buffer->_records, _swapped);
+                }
+                _writing.insert(_writing.end(), _swapped.begin(), _swapped.end());
+                _swapped.clear();
+            }
+            std::stable_sort(_writing.begin(), _writing.end(), [](auto&& lhs, auto&& rhs) { return lhs._ns < rhs._ns; });
+            auto count = _writing.size();
+            if (std::fwrite(_writing.data(), sizeof(capture_record), count, _file) != count
+                || std::fflush(_file) != 0) {
+                throw std::runtime_error("capture-write-error");
+            }
+            _writing.clear();
+            return count;
+        }
+    private:
+        auto _local() -> buffer&
+        {
+            thread_local std::shared_ptr<buffer> local = _register();
+            return *local;
+        }
+        auto _register() -> std::shared_ptr<buffer>
+        {
+            auto result = std::make_shared<buffer>();
+            std::unique_lock<std::mutex> lock(_mutex);
+            _buffers.push_back(result);
+            return result;
+        }
+    };
+
+
+    // read-only mapping of a capture file
+    class capture_file
+    {
+    private: // --- scope ---
+        using self = capture_file;
+    private: // --- state ---
+        int _fd;
+        void* _data = nullptr;
+        std::size_t _size = 0;
+    public: // --- life ---
+        explicit capture_file(const std::string& path)
+            : _fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC))
+        {
+            struct stat stat;
+            if (_fd == -1) {
+                throw std::runtime_error("capture-open-error");
+            } else if (::fstat(_fd, &stat) != 0) {
+                ::close(_fd);
+                throw std::runtime_error("capture-open-error");
+            }
+            _size = static_cast<std::size_t>(stat.st_size);
+            if (_size < sizeof(capture_header) || (_size - sizeof(capture_header)) % sizeof(capture_record) != 0) {
+                ::close(_fd);
+                throw std::runtime_error("capture-format-error");
+            }
+            _data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (_data == MAP_FAILED) {
+                ::close(_fd);
+                throw std::runtime_error("capture-mmap-error");
+            }
+            ::madvise(_data, _size, MADV_SEQUENTIAL);
+            if (header()._magic != capture_header::magic) {
+                ::munmap(_data, _size);
+                ::close(_fd);
+                throw std::runtime_error("capture-format-error");
+            }
+        }
+        capture_file(const self& rhs) = delete;
+        capture_file(self&& rhs) noexcept = delete;
+        ~capture_file() noexcept
+        {
+            ::munmap(_data, _size);
+            ::close(_fd);
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto header() const -> const capture_header&
+        {
+            return *static_cast<const capture_header*>(_data);
+        }
+        auto begin() const -> const capture_record*
+        {
+            return reinterpret_cast<const capture_record*>(static_cast<const char*>(_data) + sizeof(capture_header));
+        }
+        auto end() const -> const capture_record*
+        {
+            return reinterpret_cast<const capture_record*>(static_cast<const char*>(_data) + _size);
+        }
+        bool empty() const { return begin() == end(); }
+    };
+
+}
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <iomanip>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace demo
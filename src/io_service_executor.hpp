@@ -1,10 +1,17 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string_view>
 #include <thread>
 #include <vector>
 
 #include "boost/asio.hpp"
 
+#include "busy_poll.hpp"
+#include "memory.hpp"
+#include "numa.hpp"
 #include "thread.hpp"
 
 namespace demo
@@ -12,6 +19,23 @@ namespace demo
 
     namespace asio = boost::asio;
 
+    // per_core: one io_service per thread, shared: one io_service run by all
+    // threads, strands: like shared, with the handlers of a session in a strand
+    enum class executor_topology { per_core, shared, strands };
+
+    inline auto parse_executor_topology(std::string_view name) -> executor_topology
+    {
+        if (name == "per-core") {
+            return executor_topology::per_core;
+        } else if (name == "shared") {
+            return executor_topology::shared;
+        } else if (name == "strands") {
+            return executor_topology::strands;
+        } else {
+            throw std::runtime_error("executor-topology-error");
+        }
+    }
+
     class io_service_executor
     {
     private: // --- scope ---
@@ -20,14 +44,39 @@ namespace demo
         {
             asio::io_service _io_service;
         };
+        struct alignas(64) node_group
+        {
+            std::vector<std::size_t> _indices;
+            std::atomic<std::size_t> _next{0};
+        };
     private: // --- state ---
         std::vector<int> _cpus;
+        executor_topology _layout;
         std::vector<aligned_io_service> _io_services;
         std::size_t _next = 0;
+        bool _numa_aware;
+        std::chrono::microseconds _busy_poll;
+        numa_topology _topology;
+        std::unique_ptr<node_group[]> _groups;
+        numa_placement _placement;
     public: // --- life ---
-        explicit io_service_executor(std::vector<int> cpus)
-            : _cpus(std::move(cpus)), _io_services(_cpus.size())
-        { }
+        explicit io_service_executor(
+            std::vector<int> cpus,
+            bool numa_aware = false,
+            std::chrono::microseconds busy_poll = std::chrono::microseconds::zero(),
+            executor_topology layout = executor_topology::per_core)
+            : _cpus(std::move(cpus))
+            , _layout(layout)
+            , _io_services(_layout == executor_topology::per_core ? _cpus.size() : 1)
+            , _numa_aware(numa_aware && _layout == executor_topology::per_core)
+            , _busy_poll(busy_poll)
+            , _groups(std::make_unique<node_group[]>(_topology.node_count()))
+            , _placement(_topology.node_count())
+        {
+            for (std::size_t i = 0; i < _cpus.size(); ++i) {
+                _groups[_topology.node_of(_cpus[i])]._indices.push_back(i);
+            }
+        }
         io_service_executor(const self& rhs) = delete;
         io_service_executor(self&& rhs) noexcept = delete;
         ~io_service_executor() noexcept = default;
@@ -36,9 +85,35 @@ namespace demo
         auto operator=(self&& rhs) & noexcept -> self = delete;
         auto get_io_service() -> asio::io_service&
         {
+            if (_io_services.size() == 1) {
+                // may be called concurrently by the threads of a shared io_service
+                return _io_services[0]._io_service;
+            }
             auto index = std::exchange(_next, (_next + 1) % _io_services.size());
             return _io_services[index]._io_service;
         }
+        // falls back to round-robin, if the cpu-set has no CPU on that node
+        auto get_io_service(int incoming_cpu) -> asio::io_service&
+        {
+            auto node = _topology.node_of(incoming_cpu);
+            auto&& group = _groups[node];
+            if (incoming_cpu < 0 || group._indices.empty()) {
+                auto index = std::exchange(_next, (_next + 1) % _io_services.size());
+                _placement.record(_topology.node_of(_cpus[index]), incoming_cpu < 0 ? numa_origin::unknown : numa_origin::foreign);
+                return _io_services[index]._io_service;
+            } else {
+                auto next = group._next.fetch_add(1, std::memory_order_relaxed);
+                auto index = group._indices[next % group._indices.size()];
+                _placement.record(node, numa_origin::local);
+                return _io_services[index]._io_service;
+            }
+        }
+        auto numa_aware() const { return _numa_aware; }
+        // whether several threads run the handlers of the same io_service
+        auto shared() const { return _layout != executor_topology::per_core; }
+        auto strands() const { return _layout == executor_topology::strands; }
+        auto busy_poll() const { return _busy_poll; }
+        auto placement() const -> const numa_placement& { return _placement; }
         void run()
         {
             /* Bei den Tests sollte ueberprueft werden, dass die Cores
@@ -50,14 +125,40 @@ namespace demo
             for (std::size_t i = 0; i < _cpus.size(); ++i) {
                 threads.emplace_back([this, i] {
                         thread_affinity({_cpus[i]});
-                        asio::io_service::work guard(_io_services[i]._io_service);
-                        _io_services[i]._io_service.run();
+                        if (_numa_aware) {
+                            numa_bind_memory(_topology.node_of(_cpus[i]));
+                        }
+                        memory_add(memory_category::stacks, thread_stack_size());
+                        auto&& io_service = _io_services[i % _io_services.size()]._io_service;
+                        asio::io_service::work guard(io_service);
+                        _run(io_service);
                     });
             }
             for (auto&& thread : threads) {
                 thread.join();
             }
         }
+    private:
+        // spins on poll_one, and only blocks if no handler became ready within the budget
+        void _run(asio::io_service& io_service)
+        {
+            if (_busy_poll.count() == 0) {
+                io_service.run();
+                return;
+            }
+            using steady_clock = std::chrono::steady_clock;
+            while (!io_service.stopped()) {
+                auto until = steady_clock::now() + _busy_poll;
+                do {
+                    if (io_service.poll_one()) {
+                        global_busy_poll_stats.hit();
+                        until = steady_clock::now() + _busy_poll;
+                    }
+                } while (steady_clock::now() < until);
+                global_busy_poll_stats.miss();
+                io_service.run_one();
+            }
+        }
     };
 
 }
@@ -1,7 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 namespace demo
 {
@@ -15,12 +29,194 @@ namespace demo
         log_aux(os, std::forward<Tail>(tail)...);
     }
 
+
+    class log_string
+    {
+    public: // --- scope ---
+        static constexpr std::size_t capacity = 64;
+    private: // --- state ---
+        char _data[capacity];
+        std::size_t _size;
+        bool _truncated;
+    public: // --- life ---
+        explicit log_string(std::string_view text)
+            : _size(std::min(text.size(), capacity)), _truncated(text.size() > capacity)
+        {
+            std::memcpy(_data, text.data(), _size);
+        }
+    public: // --- operations ---
+        friend auto operator<<(std::ostream& os, const log_string& value) -> std::ostream&
+        {
+            os.write(value._data, static_cast<std::streamsize>(value._size));
+            return value._truncated ? os << "..." : os;
+        }
+    };
+
+    // character arrays are copied, since they cannot be told apart from buffers on the stack
+    template <typename Arg>
+    auto log_capture(Arg&& arg)
+    {
+        using type = std::decay_t<Arg>;
+        if constexpr (std::is_array_v<std::remove_reference_t<Arg>>) {
+            return log_string(std::string_view(arg, ::strnlen(arg, std::extent_v<std::remove_reference_t<Arg>>)));
+        } else if constexpr (std::is_convertible_v<type, std::string_view>) {
+            return log_string(arg);
+        } else if constexpr (std::is_trivially_copyable_v<type> && std::is_trivially_destructible_v<type>) {
+            return type(arg);
+        } else {
+            std::ostringstream os;
+            os << std::forward<Arg>(arg);
+            return log_string(os.str());
+        }
+    }
+
+
+    // each thread writes into its own ring, and a background thread writes to stderr
+    class logger
+    {
+    private: // --- scope ---
+        using self = logger;
+        using steady_clock = std::chrono::steady_clock;
+        static constexpr std::size_t capacity = 256;
+        static constexpr std::size_t payload_size = 240;
+        static constexpr double rate = 1000.0; // messages per second and thread
+        static constexpr double burst = 100.0;
+        struct entry
+        {
+            void (*_format)(std::ostream&, const void*);
+            alignas(std::max_align_t) unsigned char _payload[payload_size];
+        };
+        struct ring
+        {
+            std::unique_ptr<entry[]> _entries = std::make_unique<entry[]>(capacity);
+            alignas(64) std::atomic<std::size_t> _head{0};
+            alignas(64) std::atomic<std::size_t> _tail{0};
+            alignas(64) std::atomic<std::size_t> _drops{0};
+            double _tokens = burst;
+            steady_clock::time_point _refill = steady_clock::now();
+        };
+    private: // --- state ---
+        std::mutex _mutex;
+        std::vector<std::shared_ptr<ring>> _rings;
+        std::atomic<bool> _stop{false};
+        std::thread _thread;
+    public: // --- life ---
+        explicit logger()
+            : _thread([this] { _run(); })
+        { }
+        logger(const self& rhs) = delete;
+        logger(self&& rhs) noexcept = delete;
+        ~logger() noexcept
+        {
+            _stop = true;
+            _thread.join();
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        template <typename... Args>
+        void write(Args&&... args)
+        {
+            using payload = std::tuple<decltype(log_capture(std::forward<Args>(args)))...>;
+            static_assert(sizeof(payload) <= payload_size, "log message too large");
+            static_assert(alignof(payload) <= alignof(std::max_align_t));
+            static_assert(std::is_trivially_destructible_v<payload>);
+            auto&& ring = _local();
+            auto head = ring._head.load(std::memory_order_relaxed);
+            if (!_admit(ring) || head - ring._tail.load(std::memory_order_acquire) == capacity) {
+                ring._drops.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            auto&& entry = ring._entries[head % capacity];
+            new (entry._payload) payload(log_capture(std::forward<Args>(args))...);
+            entry._format = &_format<payload>;
+            ring._head.store(head + 1, std::memory_order_release);
+        }
+    private:
+        auto _local() -> ring&
+        {
+            thread_local std::shared_ptr<ring> local = _register();
+            return *local;
+        }
+        auto _register() -> std::shared_ptr<ring>
+        {
+            auto result = std::make_shared<ring>();
+            std::unique_lock<std::mutex> lock(_mutex);
+            _rings.push_back(result);
+            return result;
+        }
+        // token bucket per thread
+        static bool _admit(ring& ring)
+        {
+            auto now = steady_clock::now();
+            auto elapsed = std::chrono::duration<double>(now - ring._refill).count();
+            ring._refill = now;
+            ring._tokens = std::min(burst, ring._tokens + elapsed * rate);
+            if (ring._tokens < 1.0) {
+                return false;
+            }
+            ring._tokens -= 1.0;
+            return true;
+        }
+        template <typename Payload>
+        static void _format(std::ostream& os, const void* payload)
+        {
+            std::apply([&os](auto&&... args) { log_aux(os, args...); }, *static_cast<const Payload*>(payload));
+        }
+        void _run()
+        {
+            for (bool stop = false; !stop; ) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                stop = _stop;
+                _flush();
+            }
+        }
+        void _flush()
+        {
+            std::vector<std::shared_ptr<ring>> rings;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                // release the rings of terminated threads
+                _rings.erase(
+                    std::remove_if(_rings.begin(), _rings.end(), [](auto&& ring) {
+                            return ring.use_count() == 1
+                                && ring->_head.load(std::memory_order_acquire) == ring->_tail.load(std::memory_order_relaxed)
+                                && ring->_drops.load(std::memory_order_relaxed) == 0;
+                        }),
+                    _rings.end());
+                rings = _rings;
+            }
+            std::ostringstream os;
+            for (auto&& ring : rings) {
+                auto head = ring->_head.load(std::memory_order_acquire);
+                auto tail = ring->_tail.load(std::memory_order_relaxed);
+                for (; tail != head; ++tail) {
+                    auto&& entry = ring->_entries[tail % capacity];
+                    entry._format(os, entry._payload);
+                }
+                ring->_tail.store(tail, std::memory_order_release);
+                if (auto drops = ring->_drops.exchange(0, std::memory_order_relaxed)) {
+                    os << "WARN: log messages dropped: " << drops << '\n';
+                }
+            }
+            auto text = os.str();
+            if (!text.empty()) {
+                std::cerr << text << std::flush;
+            }
+        }
+    };
+
+    inline auto global_logger() -> logger&
+    {
+        static logger instance;
+        return instance;
+    }
+
+    // string arguments longer than log_string::capacity bytes are cut
     template <typename... Args>
     void log(Args&&... args)
     {
-        std::ostringstream os;
-        log_aux(os, std::forward<Args>(args)..., '\n');
-        std::cerr << os.str();
+        global_logger().write(std::forward<Args>(args)..., '\n');
     }
 
 }
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <utility>
+
+#include <dirent.h>
+#include <linux/sock_diag.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/sysinfo.h>
+
+#ifndef SO_MEMINFO
+#define SO_MEMINFO 55
+#endif
+
+// memory profile per connection, enabled with -DDEMO_MEMORY_PROFILE
+
+namespace demo
+{
+
+    enum class memory_category : std::size_t
+    {
+        stacks,     // thread stacks
+        sessions,   // session and stream objects
+        buffers,    // capacity of demo::buffer
+        handlers,   // Asio operations including timer waits
+        count,
+    };
+
+
+    inline auto thread_stack_size() -> std::size_t
+    {
+        std::size_t result = 0;
+        pthread_attr_t attr;
+        if (::pthread_getattr_np(::pthread_self(), &attr) == 0) {
+            ::pthread_attr_getstacksize(&attr, &result);
+            ::pthread_attr_destroy(&attr);
+        }
+        return result;
+    }
+
+    // iterates over all file descriptors, only for periodic reports
+    inline auto kernel_socket_memory() -> std::size_t
+    {
+        std::size_t result = 0;
+        std::unique_ptr<DIR, int(*)(DIR*)> dir(::opendir("/proc/self/fd"), &::closedir);
+        if (dir) {
+            while (auto entry = ::readdir(dir.get())) {
+                int fd = std::atoi(entry->d_name);
+                std::uint32_t info[SK_MEMINFO_VARS] = {};
+                socklen_t size = sizeof(info);
+                if (entry->d_name[0] != '.' && ::getsockopt(fd, SOL_SOCKET, SO_MEMINFO, info, &size) == 0) {
+                    result += std::size_t(info[SK_MEMINFO_RMEM_ALLOC])
+                        + info[SK_MEMINFO_WMEM_QUEUED]
+                        + info[SK_MEMINFO_FWD_ALLOC]
+                        + info[SK_MEMINFO_OPTMEM]
+                        + info[SK_MEMINFO_BACKLOG];
+                }
+            }
+        }
+        return result;
+    }
+
+
+    // only the sum over all slots is meaningful, since memory may be freed on another CPU
+    class memory_profile
+    {
+    private: // --- scope ---
+        using self = memory_profile;
+        static constexpr auto category_count = static_cast<std::size_t>(memory_category::count);
+        struct alignas(64) slot
+        {
+            std::array<std::atomic<std::uint64_t>, category_count> _bytes{};
+        };
+    private: // --- state ---
+        std::size_t _size;
+        std::unique_ptr<slot[]> _slots;
+    public: // --- life ---
+        explicit memory_profile()
+            : _size(static_cast<std::size_t>(std::max(::get_nprocs_conf(), 1)))
+            , _slots(std::make_unique<slot[]>(_size))
+        { }
+        memory_profile(const self& rhs) = delete;
+        memory_profile(self&& rhs) noexcept = delete;
+        ~memory_profile() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        void add(memory_category category, std::size_t bytes)
+        {
+            _local()._bytes[static_cast<std::size_t>(category)].fetch_add(bytes, std::memory_order_relaxed);
+        }
+        void sub(memory_category category, std::size_t bytes)
+        {
+            _local()._bytes[static_cast<std::size_t>(category)].fetch_sub(bytes, std::memory_order_relaxed);
+        }
+        void print(std::ostream& os, long long timestamp, std::uint64_t connections)
+        {
+            std::array<std::uint64_t, category_count> total{};
+            for (std::size_t i = 0; i != _size; ++i) {
+                for (std::size_t c = 0; c != category_count; ++c) {
+                    total[c] += _slots[i]._bytes[c].load(std::memory_order_relaxed);
+                }
+            }
+            auto divisor = std::max<std::uint64_t>(connections, 1);
+            os << "MEMORY: " << timestamp << " " << connections;
+            for (auto&& bytes : total) {
+                os << " " << bytes / divisor;
+            }
+            os << " " << kernel_socket_memory() / divisor << std::endl;
+        }
+    private:
+        auto _local() -> slot&
+        {
+            thread_local std::size_t index = static_cast<std::size_t>(std::max(::sched_getcpu(), 0));
+            return _slots[index % _size];
+        }
+    };
+
+}
+
+#ifdef DEMO_MEMORY_PROFILE
+
+namespace demo
+{
+
+    inline memory_profile global_memory_profile;
+
+    inline void memory_add(memory_category category, std::size_t bytes) { global_memory_profile.add(category, bytes); }
+    inline void memory_sub(memory_category category, std::size_t bytes) { global_memory_profile.sub(category, bytes); }
+
+    inline void memory_flush(std::ostream& os, long long timestamp, std::uint64_t connections)
+    {
+        global_memory_profile.print(os, timestamp, connections);
+    }
+
+
+    template <typename Type>
+    class memory_counting_allocator
+    {
+    public: // --- scope ---
+        using value_type = Type;
+    public: // --- life ---
+        explicit memory_counting_allocator() = default;
+        template <typename Other>
+        memory_counting_allocator(const memory_counting_allocator<Other>& rhs [[maybe_unused]]) noexcept { }
+    public: // --- operations ---
+        auto allocate(std::size_t n) -> Type*
+        {
+            auto result = std::allocator<Type>().allocate(n);
+            memory_add(memory_category::handlers, n * sizeof(Type));
+            return result;
+        }
+        void deallocate(Type* p, std::size_t n)
+        {
+            memory_sub(memory_category::handlers, n * sizeof(Type));
+            std::allocator<Type>().deallocate(p, n);
+        }
+        template <typename Other>
+        friend bool operator==(const memory_counting_allocator& lhs [[maybe_unused]], const memory_counting_allocator<Other>& rhs [[maybe_unused]]) { return true; }
+        template <typename Other>
+        friend bool operator!=(const memory_counting_allocator& lhs [[maybe_unused]], const memory_counting_allocator<Other>& rhs [[maybe_unused]]) { return false; }
+    };
+
+    template <typename Handler>
+    class memory_counted_handler
+    {
+    public: // --- scope ---
+        using allocator_type = memory_counting_allocator<void>;
+    private: // --- state ---
+        Handler _handler;
+    public: // --- life ---
+        explicit memory_counted_handler(Handler handler)
+            : _handler(std::move(handler))
+        { }
+    public: // --- operations ---
+        auto get_allocator() const noexcept { return allocator_type(); }
+        template <typename... Args>
+        void operator()(Args&&... args)
+        {
+            _handler(std::forward<Args>(args)...);
+        }
+    };
+
+    template <typename Handler>
+    auto memory_counted(Handler handler)
+    {
+        return memory_counted_handler<Handler>(std::move(handler));
+    }
+
+}
+
+#else
+
+namespace demo
+{
+    inline void memory_add(memory_category category [[maybe_unused]], std::size_t bytes [[maybe_unused]]) { }
+    inline void memory_sub(memory_category category [[maybe_unused]], std::size_t bytes [[maybe_unused]]) { }
+    inline void memory_flush(std::ostream& os [[maybe_unused]], long long timestamp [[maybe_unused]], std::uint64_t connections [[maybe_unused]]) { }
+    template <typename Handler>
+    auto memory_counted(Handler handler) { return handler; }
+}
+
+#endif
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+#include <sched.h>
+#include <sys/sysinfo.h>
+
+namespace demo
+{
+
+    // each pinned thread updates the slot of its CPU
+    class server_metrics
+    {
+    public: // --- scope ---
+        enum counter : std::size_t
+        {
+            accepts,
+            sessions,
+            requests,
+            bytes_in,
+            bytes_out,
+            timeouts,
+            protocol_errors,
+            rejects,
+            shed,
+            latencies,
+            counter_count,
+        };
+        // bucket i contains latencies in [2^i, 2^(i+1)) microseconds
+        static constexpr std::size_t bucket_count = 32;
+    private:
+        using self = server_metrics;
+        using steady_clock = std::chrono::steady_clock;
+        struct alignas(64) slot
+        {
+            std::array<std::atomic<std::uint64_t>, counter_count> _counters{};
+            std::array<std::atomic<std::uint64_t>, bucket_count> _buckets{};
+        };
+        struct snapshot
+        {
+            std::array<std::uint64_t, counter_count> _counters{};
+            std::array<std::uint64_t, bucket_count> _buckets{};
+            steady_clock::time_point _time = steady_clock::now();
+        };
+    private: // --- state ---
+        std::size_t _size;
+        std::unique_ptr<slot[]> _slots;
+        snapshot _previous;
+    public: // --- life ---
+        explicit server_metrics()
+            : _size(static_cast<std::size_t>(std::max(::get_nprocs_conf(), 1)))
+            , _slots(std::make_unique<slot[]>(_size))
+        { }
+        server_metrics(const self& rhs) = delete;
+        server_metrics(self&& rhs) noexcept = delete;
+        ~server_metrics() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        void add(counter counter, std::uint64_t value = 1)
+        {
+            _local()._counters[counter].fetch_add(value, std::memory_order_relaxed);
+        }
+        void sub(counter counter, std::uint64_t value = 1)
+        {
+            _local()._counters[counter].fetch_sub(value, std::memory_order_relaxed);
+        }
+        // current value, aggregated over all slots
+        auto value(counter counter) const -> std::uint64_t
+        {
+            std::uint64_t result = 0;
+            for (std::size_t i = 0; i != _size; ++i) {
+                result += _slots[i]._counters[counter].load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+        void latency(steady_clock::duration duration)
+        {
+            auto&& local = _local();
+            auto us = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+            std::size_t bucket = 0;
+            while (bucket + 1 < bucket_count && (us >> (bucket + 1)) != 0) {
+                ++bucket;
+            }
+            local._counters[latencies].fetch_add(us, std::memory_order_relaxed);
+            local._buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+        // the first three columns of STATUS match the client
+        void print(std::ostream& os, long long timestamp)
+        {
+            snapshot current;
+            for (std::size_t i = 0; i != _size; ++i) {
+                for (std::size_t c = 0; c != counter_count; ++c) {
+                    current._counters[c] += _slots[i]._counters[c].load(std::memory_order_relaxed);
+                }
+                for (std::size_t b = 0; b != bucket_count; ++b) {
+                    current._buckets[b] += _slots[i]._buckets[b].load(std::memory_order_relaxed);
+                }
+            }
+            auto delta = [&](counter c) { return current._counters[c] - _previous._counters[c]; };
+            auto elapsed = std::chrono::duration<double>(current._time - _previous._time).count();
+            auto count = delta(requests);
+            os << "STATUS: " << timestamp
+               << " " << static_cast<std::uint64_t>(elapsed > 0 ? count / elapsed : 0)
+               << " " << delta(latencies) / (count + 1)
+               << " " << current._counters[sessions]
+               << " " << _percentile(current, 0.99)
+               << "\n";
+            os << "METRICS: " << timestamp
+               << " " << delta(accepts)
+               << " " << count
+               << " " << delta(bytes_in)
+               << " " << delta(bytes_out)
+               << " " << delta(timeouts)
+               << " " << delta(protocol_errors)
+               << " " << delta(rejects)
+               << " " << delta(shed)
+               << std::endl;
+            _previous = current;
+        }
+    private:
+        auto _local() -> slot&
+        {
+            thread_local std::size_t index = static_cast<std::size_t>(std::max(::sched_getcpu(), 0));
+            return _slots[index % _size];
+        }
+        auto _percentile(const snapshot& current, double ratio) const -> std::uint64_t
+        {
+            std::uint64_t total = 0;
+            for (std::size_t b = 0; b != bucket_count; ++b) {
+                total += current._buckets[b] - _previous._buckets[b];
+            }
+            auto threshold = static_cast<std::uint64_t>(ratio * double(total));
+            std::uint64_t sum = 0;
+            for (std::size_t b = 0; b != bucket_count; ++b) {
+                sum += current._buckets[b] - _previous._buckets[b];
+                if (sum > threshold) {
+                    return std::uint64_t(1) << (b + 1);
+                }
+            }
+            return 0;
+        }
+    };
+
+    inline server_metrics global_server_metrics;
+
+}
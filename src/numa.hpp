@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace demo
+{
+
+    // e.g. "0-3,8-11"
+    inline auto parse_cpu_list(const std::string& text) -> std::vector<int>
+    {
+        std::vector<int> result;
+        std::size_t p = 0;
+        while (p < text.size()) {
+            auto q = text.find_first_of(",\n", p);
+            if (q == std::string::npos) {
+                q = text.size();
+            }
+            auto item = text.substr(p, q - p);
+            if (!item.empty()) {
+                auto r = item.find('-');
+                int first = std::stoi(item.substr(0, r));
+                int last = r == std::string::npos ? first : std::stoi(item.substr(r + 1));
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    result.push_back(cpu);
+                }
+            }
+            p = q + 1;
+        }
+        return result;
+    }
+
+
+    class numa_topology
+    {
+    private: // --- scope ---
+        using self = numa_topology;
+    private: // --- state ---
+        std::vector<std::vector<int>> _nodes;
+        std::vector<int> _cpu_to_node;
+    public: // --- life ---
+        explicit numa_topology(const std::string& path = "/sys/devices/system/node")
+        {
+            if (auto dir = ::opendir(path.c_str())) {
+                while (auto entry = ::readdir(dir)) {
+                    std::string name = entry->d_name;
+                    if (name.size() > 4 && name.compare(0, 4, "node") == 0
+                        && name.find_first_not_of("0123456789", 4) == std::string::npos) {
+                        auto node = static_cast<std::size_t>(std::stoi(name.substr(4)));
+                        std::ifstream is(path + "/" + name + "/cpulist");
+                        std::string text;
+                        std::getline(is, text);
+                        if (_nodes.size() <= node) {
+                            _nodes.resize(node + 1);
+                        }
+                        _nodes[node] = parse_cpu_list(text);
+                    }
+                }
+                ::closedir(dir);
+            }
+            if (_nodes.empty()) {
+                // no NUMA support: a single node containing all CPUs
+                _nodes.emplace_back();
+                for (int cpu = 0; cpu < int(std::thread::hardware_concurrency()); ++cpu) {
+                    _nodes.back().push_back(cpu);
+                }
+            }
+            for (std::size_t node = 0; node != _nodes.size(); ++node) {
+                for (auto&& cpu : _nodes[node]) {
+                    if (_cpu_to_node.size() <= std::size_t(cpu)) {
+                        _cpu_to_node.resize(std::size_t(cpu) + 1, 0);
+                    }
+                    _cpu_to_node[std::size_t(cpu)] = int(node);
+                }
+            }
+        }
+    public: // --- operations ---
+        auto node_count() const { return _nodes.size(); }
+        auto cpus(std::size_t node) const -> const std::vector<int>& { return _nodes[node]; }
+        auto node_of(int cpu) const -> std::size_t
+        {
+            if (cpu >= 0 && std::size_t(cpu) < _cpu_to_node.size()) {
+                return std::size_t(_cpu_to_node[std::size_t(cpu)]);
+            } else {
+                return 0;
+            }
+        }
+    };
+
+
+    inline void numa_bind_memory(std::size_t node)
+    {
+        constexpr auto bits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask(node / bits + 1);
+        mask[node / bits] |= 1ul << (node % bits);
+        if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(), mask.size() * bits + 1) != 0) {
+            throw std::runtime_error("numa-mempolicy-error");
+        }
+    }
+
+
+    // -1 if unknown
+    inline auto get_incoming_cpu(int fd) -> int
+    {
+        int cpu = -1;
+        socklen_t length = sizeof(cpu);
+        if (::getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) != 0) {
+            return -1;
+        }
+        return cpu;
+    }
+
+
+    enum class numa_origin { local, foreign, unknown };
+
+    class numa_placement
+    {
+    private: // --- scope ---
+        using self = numa_placement;
+        struct alignas(64) counters
+        {
+            std::atomic<std::size_t> _connections{0};
+            std::atomic<std::size_t> _foreign{0};
+            std::atomic<std::size_t> _unknown{0};
+        };
+    private: // --- state ---
+        std::size_t _size;
+        std::unique_ptr<counters[]> _counters;
+    public: // --- life ---
+        explicit numa_placement(std::size_t nodes)
+            : _size(nodes), _counters(std::make_unique<counters[]>(nodes))
+        { }
+    public: // --- operations ---
+        void record(std::size_t node, numa_origin origin)
+        {
+            _counters[node]._connections.fetch_add(1, std::memory_order_relaxed);
+            if (origin == numa_origin::foreign) {
+                _counters[node]._foreign.fetch_add(1, std::memory_order_relaxed);
+            } else if (origin == numa_origin::unknown) {
+                _counters[node]._unknown.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        void print(std::ostream& os, long long timestamp) const
+        {
+            for (std::size_t node = 0; node != _size; ++node) {
+                os << "NUMA: " << timestamp
+                   << " " << node
+                   << " " << _counters[node]._connections.load(std::memory_order_relaxed)
+                   << " " << _counters[node]._foreign.load(std::memory_order_relaxed)
+                   << " " << _counters[node]._unknown.load(std::memory_order_relaxed)
+                   << "\n";
+            }
+            os << std::flush;
+        }
+    };
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include <unistd.h>
+
+namespace demo
+{
+
+    // in KiB, or zero if unavailable
+    inline auto resident_memory() -> std::size_t
+    {
+        std::size_t size = 0, resident = 0;
+        if (auto file = std::fopen("/proc/self/statm", "r")) {
+            if (std::fscanf(file, "%zu %zu", &size, &resident) != 2) {
+                resident = 0;
+            }
+            std::fclose(file);
+        }
+        return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)) / 1024;
+    }
+
+
+    // the CyclicBarrier of examples/tomcat-party, a size of zero never parks
+    class party
+    {
+    private: // --- scope ---
+        using self = party;
+    private: // --- state ---
+        std::size_t _size;
+        std::mutex _mutex;
+        std::condition_variable _complete;
+        std::size_t _parked = 0;
+        std::size_t _generation = 0;
+        std::vector<std::function<void()>> _handlers;
+        std::size_t _base_memory = resident_memory();
+        std::atomic<std::size_t> _peak_memory{0};
+    public: // --- life ---
+        explicit party(std::size_t size)
+            : _size(size)
+        { }
+        party(const self& rhs) = delete;
+        party(self&& rhs) noexcept = delete;
+        ~party() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto size() const { return _size; }
+        // blocks the calling thread until the party is complete
+        void await()
+        {
+            if (_size) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto generation = _generation;
+                if (++_parked == _size) {
+                    _release(lock);
+                } else {
+                    _complete.wait(lock, [this,generation] { return _generation != generation; });
+                }
+            }
+        }
+        // the handlers are invoked on the thread completing the party
+        template <typename Handler>
+        void async_await(Handler handler)
+        {
+            if (_size) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _handlers.emplace_back(std::move(handler));
+                if (++_parked == _size) {
+                    _release(lock);
+                }
+            } else {
+                handler();
+            }
+        }
+        void print(std::ostream& os, long long timestamp)
+        {
+            std::size_t generation;
+            std::size_t parked;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                generation = _generation;
+                parked = _parked;
+            }
+            auto peak = _peak_memory.load(std::memory_order_relaxed);
+            auto used = peak > _base_memory ? peak - _base_memory : 0;
+            os << "PARTY: " << timestamp
+               << " " << generation
+               << " " << parked
+               << " " << peak
+               << " " << used / _size
+               << std::endl;
+        }
+    private:
+        void _release(std::unique_lock<std::mutex>& lock)
+        {
+            auto memory = resident_memory();
+            if (memory > _peak_memory.load(std::memory_order_relaxed)) {
+                _peak_memory.store(memory, std::memory_order_relaxed);
+            }
+            _parked = 0;
+            ++_generation;
+            std::vector<std::function<void()>> handlers;
+            swap(_handlers, handlers);
+            lock.unlock();
+            _complete.notify_all();
+            for (auto&& handler : handlers) {
+                handler();
+            }
+        }
+    };
+
+}
@@ -0,0 +1,104 @@
+#include <atomic>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "boost/asio.hpp"
+
+#include "address.hpp"
+#include "command_line.hpp"
+#include "protocol.hpp"
+
+// counterpart of examples/tomcat-party/PartyClient.java
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+    namespace asio = boost::asio;
+    using namespace demo;
+
+    using error_code = boost::system::error_code;
+    using tcp = asio::ip::tcp;
+    // TCP or Unix domain sockets
+    using stream_protocol = asio::generic::stream_protocol;
+
+
+    void run(stream_protocol::endpoint endpoint, const std::string& request, std::size_t response_size, std::atomic<std::size_t>& total)
+    {
+        asio::io_service io_service;
+        std::vector<char> response(response_size);
+        for (;;) {
+            stream_protocol::socket socket(io_service);
+            socket.connect(endpoint);
+            if (endpoint.protocol().family() != AF_UNIX) {
+                socket.set_option(tcp::no_delay(true));
+            }
+            asio::write(socket, asio::buffer(request));
+            asio::read(socket, asio::buffer(response));
+            socket.close();
+            total.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    try {
+        std::ios::sync_with_stdio(false);
+        // command line arguments
+        std::string addr = "127.0.0.1";
+        std::vector<std::string> ports{"9999"};
+        std::size_t concurrency = 1000;
+        std::size_t payload = 16;
+        std::string protocol_name{protocol::line_reverse::name};
+        parse_command_line(std::cout, argc - 1, argv + 1,
+            "remote-addr", addr,
+            "remote-ports", ports,
+            "concurrency", concurrency,
+            "payload-size", payload,
+            "protocol", protocol_name);
+        // run
+        std::string request;
+        std::size_t response_size = 0;
+        protocol::with_protocol(protocol_name, [&](auto protocol [[maybe_unused]]) {
+            using protocol_type = decltype(protocol);
+            request.resize(protocol_type::request_size(payload));
+            protocol_type::make_request(request.data(), payload);
+            response_size = protocol_type::response_size(payload);
+        });
+        auto address = asio::ip::address::from_string(addr);
+        std::atomic<std::size_t> total{0};
+        for (std::size_t i = 0; i != concurrency; ++i) {
+            auto&& port = ports[i % ports.size()];
+            stream_protocol::endpoint endpoint = is_unix_address(port)
+                ? stream_protocol::endpoint(asio::local::stream_protocol::endpoint(unix_path(port)))
+                : stream_protocol::endpoint(tcp::endpoint(address, tcp_port(port)));
+            std::thread([endpoint,&request,response_size,&total] {
+                    try {
+                        run(endpoint, request, response_size, total);
+                    } catch (const std::exception& e) {
+                        std::cerr << "ERROR: " << e.what() << "\n";
+                        std::exit(EXIT_FAILURE);
+                    }
+                }).detach();
+            std::this_thread::sleep_for(1ms);
+        }
+        for (std::size_t previous = 0;;) {
+            std::this_thread::sleep_for(1s);
+            auto now = std::chrono::system_clock::now().time_since_epoch();
+            auto current = total.load(std::memory_order_relaxed);
+            std::cout << "STATUS: "
+                      << std::chrono::duration_cast<std::chrono::seconds>(now).count()
+                      << " " << current - previous
+                      << " " << current
+                      << std::endl;
+            previous = current;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "store.hpp"
+
+// frame() returns the size of the request, incomplete or invalid, and process() the
+// response, which stays valid until the next call and may be sent from a file
+
+namespace demo::protocol
+{
+
+    constexpr std::size_t incomplete = 0;
+    constexpr std::size_t invalid = std::size_t(-1);
+
+    struct response
+    {
+        const char* _data;
+        std::size_t _size;
+        int _fd = -1;
+        std::size_t _offset = 0;
+    };
+
+    inline void fill_payload(char* data, std::size_t size)
+    {
+        for (std::size_t i = 0; i != size; ++i) {
+            data[i] = static_cast<char>('A' + i % 26);
+        }
+    }
+
+
+    // a line of text, answered with the reversed line
+    class line_reverse
+    {
+    public: // --- scope ---
+        static constexpr std::string_view name = "line-reverse";
+        static constexpr std::string_view busy = "503 BUSY\n";
+    public: // --- operations ---
+        auto frame(const char* data, std::size_t size, std::size_t offset) const -> std::size_t
+        {
+            auto p = static_cast<const char*>(std::memchr(data + offset, '\n', size - offset));
+            return p ? static_cast<std::size_t>(p - data) + 1 : incomplete;
+        }
+        auto process(char* data, std::size_t size) -> response
+        {
+            std::reverse(data, data + size - 1);
+            return {data, size};
+        }
+        static auto request_size(std::size_t payload) -> std::size_t { return payload + 1; }
+        static auto response_size(std::size_t payload) -> std::size_t { return payload + 1; }
+        static void make_request(char* data, std::size_t payload)
+        {
+            fill_payload(data, payload);
+            data[payload] = '\n';
+        }
+    };
+
+
+    // all available data, answered unmodified
+    class echo
+    {
+    public: // --- scope ---
+        static constexpr std::string_view name = "echo";
+        static constexpr std::string_view busy = line_reverse::busy;
+    public: // --- operations ---
+        auto frame(const char* data [[maybe_unused]], std::size_t size, std::size_t offset [[maybe_unused]]) const -> std::size_t
+        {
+            return size;
+        }
+        auto process(char* data, std::size_t size) -> response
+        {
+            return {data, size};
+        }
+        static auto request_size(std::size_t payload) -> std::size_t { return payload + 1; }
+        static auto response_size(std::size_t payload) -> std::size_t { return payload + 1; }
+        static void make_request(char* data, std::size_t payload)
+        {
+            line_reverse::make_request(data, payload);
+        }
+    };
+
+
+    // binary frames with a 32 bit big-endian length, answered with the
+    // reversed payload
+    class length_prefixed
+    {
+    public: // --- scope ---
+        static constexpr std::string_view name = "length-prefixed";
+        static constexpr std::size_t header_size = 4;
+        static constexpr std::size_t max_payload = std::size_t(1) << 24;
+        // a length beyond max_payload
+        static constexpr std::string_view busy = "\xff\xff\xff\xff";
+    public: // --- operations ---
+        auto frame(const char* data, std::size_t size, std::size_t offset [[maybe_unused]]) const -> std::size_t
+        {
+            if (size < header_size) {
+                return incomplete;
+            }
+            auto p = reinterpret_cast<const unsigned char*>(data);
+            auto payload = std::size_t(p[0]) << 24 | std::size_t(p[1]) << 16 | std::size_t(p[2]) << 8 | std::size_t(p[3]);
+            if (payload > max_payload) {
+                return invalid;
+            }
+            return size < header_size + payload ? incomplete : header_size + payload;
+        }
+        auto process(char* data, std::size_t size) -> response
+        {
+            std::reverse(data + header_size, data + size);
+            return {data, size};
+        }
+        static auto request_size(std::size_t payload) -> std::size_t { return header_size + payload; }
+        static auto response_size(std::size_t payload) -> std::size_t { return header_size + payload; }
+        static void make_request(char* data, std::size_t payload)
+        {
+            auto p = reinterpret_cast<unsigned char*>(data);
+            p[0] = static_cast<unsigned char>(payload >> 24);
+            p[1] = static_cast<unsigned char>(payload >> 16);
+            p[2] = static_cast<unsigned char>(payload >> 8);
+            p[3] = static_cast<unsigned char>(payload);
+            fill_payload(data + header_size, payload);
+        }
+    };
+
+
+    // minimal HTTP/1.1 with persistent connections, answered with the
+    // request body
+    class http
+    {
+    public: // --- scope ---
+        static constexpr std::string_view name = "http";
+        static constexpr std::size_t max_header = 8192;
+        static constexpr std::string_view request_head = "POST / HTTP/1.1\r\nHost: demo\r\nContent-Length: ";
+        static constexpr std::string_view response_head = "HTTP/1.1 200 OK\r\nContent-Length: ";
+        static constexpr std::string_view busy = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    private: // --- state ---
+        std::string _response;
+        std::size_t _header = 0;
+        std::size_t _content_length = 0;
+    public: // --- operations ---
+        auto frame(const char* data, std::size_t size, std::size_t offset) -> std::size_t
+        {
+            if (_header == 0) {
+                std::string_view text(data, size);
+                auto end = text.find("\r\n\r\n", offset < 3 ? 0 : offset - 3);
+                if (end == std::string_view::npos) {
+                    return size > max_header ? invalid : incomplete;
+                }
+                _header = end + 4;
+                if (!_parse_header(text.substr(0, end))) {
+                    _header = 0;
+                    return invalid;
+                }
+            }
+            if (size < _header + _content_length) {
+                return incomplete;
+            }
+            return _header + _content_length;
+        }
+        auto process(char* data, std::size_t size) -> response
+        {
+            _response.assign(response_head);
+            _response.append(std::to_string(_content_length));
+            _response.append("\r\n\r\n");
+            _response.append(data + _header, size - _header);
+            _header = 0;
+            _content_length = 0;
+            return {_response.data(), _response.size()};
+        }
+        static auto request_size(std::size_t payload) -> std::size_t
+        {
+            return request_head.size() + std::to_string(payload).size() + 4 + payload;
+        }
+        static auto response_size(std::size_t payload) -> std::size_t
+        {
+            return response_head.size() + std::to_string(payload).size() + 4 + payload;
+        }
+        static void make_request(char* data, std::size_t payload)
+        {
+            auto length = std::to_string(payload);
+            data = std::copy(request_head.begin(), request_head.end(), data);
+            data = std::copy(length.begin(), length.end(), data);
+            data = std::copy_n("\r\n\r\n", 4, data);
+            fill_payload(data, payload);
+        }
+    private:
+        bool _parse_header(std::string_view header)
+        {
+            auto eol = header.find("\r\n");
+            auto request_line = header.substr(0, eol);
+            if (request_line.size() < 14 || request_line.compare(request_line.size() - 8, 7, "HTTP/1.") != 0) {
+                return false;
+            }
+            _content_length = 0;
+            while (eol != std::string_view::npos) {
+                header.remove_prefix(eol + 2);
+                eol = header.find("\r\n");
+                auto line = header.substr(0, eol);
+                constexpr std::string_view key = "content-length:";
+                if (line.size() > key.size() && std::equal(key.begin(), key.end(), line.begin(),
+                        [](char lhs, char rhs) { return lhs == (rhs | 0x20); })) {
+                    auto value = line.substr(key.size());
+                    value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+                    if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string_view::npos) {
+                        return false;
+                    }
+                    _content_length = std::stoul(std::string(value));
+                }
+            }
+            return true;
+        }
+    };
+
+
+    // a line with the decimal key of a value in the global payload store,
+    // answered with the value sent directly from the store with sendfile
+    class file_store
+    {
+    public: // --- scope ---
+        static constexpr std::string_view name = "file-store";
+        static constexpr std::string_view busy = line_reverse::busy;
+        static constexpr std::size_t max_digits = 12;
+    protected: // --- state ---
+        std::size_t _key = 0;
+    public: // --- operations ---
+        auto frame(const char* data, std::size_t size, std::size_t offset) -> std::size_t
+        {
+            auto p = static_cast<const char*>(std::memchr(data + offset, '\n', size - offset));
+            if (!p) {
+                return size > max_digits ? invalid : incomplete;
+            }
+            std::string_view key(data, static_cast<std::size_t>(p - data));
+            if (key.empty() || key.size() > max_digits || key.find_first_not_of("0123456789") != std::string_view::npos) {
+                return invalid;
+            }
+            _key = std::stoul(std::string(key));
+            return global_payload_store().contains(_key) ? key.size() + 1 : invalid;
+        }
+        auto process(char* data [[maybe_unused]], std::size_t size [[maybe_unused]]) -> response
+        {
+            auto&& store = global_payload_store();
+            auto offset = store.offset(_key);
+            return {store.data() + offset, _key, store.fd(), offset};
+        }
+        static auto request_size(std::size_t payload) -> std::size_t { return std::to_string(payload).size() + 1; }
+        static auto response_size(std::size_t payload) -> std::size_t { return payload; }
+        static void make_request(char* data, std::size_t payload)
+        {
+            auto key = std::to_string(payload);
+            data = std::copy(key.begin(), key.end(), data);
+            *data = '\n';
+        }
+    };
+
+
+    // the same as file_store, but the value is written from the mapping of
+    // the store, i.e. copied through user space
+    class file_store_copy : public file_store
+    {
+    public: // --- scope ---
+        static constexpr std::string_view name = "file-store-copy";
+    public: // --- operations ---
+        auto process(char* data [[maybe_unused]], std::size_t size [[maybe_unused]]) -> response
+        {
+            auto&& store = global_payload_store();
+            return {store.data() + store.offset(_key), _key};
+        }
+    };
+
+
+    // whether the protocol of the given name serves the global payload store
+    inline bool uses_payload_store(std::string_view name)
+    {
+        return name == file_store::name || name == file_store_copy::name;
+    }
+
+
+    template <typename Function>
+    void with_protocol(std::string_view name, Function&& function)
+    {
+        if (name == line_reverse::name) {
+            function(line_reverse());
+        } else if (name == echo::name) {
+            function(echo());
+        } else if (name == length_prefixed::name) {
+            function(length_prefixed());
+        } else if (name == http::name) {
+            function(http());
+        } else if (name == file_store::name) {
+            function(file_store());
+        } else if (name == file_store_copy::name) {
+            function(file_store_copy());
+        } else {
+            throw std::runtime_error("unknown-protocol");
+        }
+    }
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef DEMO_STORE_SIZE
+#define DEMO_STORE_SIZE (std::size_t(64) << 20)
+#endif
+
+namespace demo
+{
+
+    // the key of a value is its size, so the client knows the size of the response
+    class payload_store
+    {
+    private: // --- scope ---
+        using self = payload_store;
+    private: // --- state ---
+        int _fd = -1;
+        char* _data = nullptr;
+        std::size_t _size;
+    public: // --- life ---
+        explicit payload_store(std::size_t size)
+            : _size(size)
+        {
+            _fd = ::memfd_create("demo-store", MFD_CLOEXEC);
+            if (_fd == -1 || ::ftruncate(_fd, static_cast<off_t>(_size)) != 0) {
+                throw std::runtime_error("store-create-error");
+            }
+            auto data = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(_fd);
+                throw std::runtime_error("store-mmap-error");
+            }
+            _data = static_cast<char*>(data);
+            for (std::size_t i = 0; i != _size; ++i) {
+                _data[i] = static_cast<char>('a' + i % 26);
+            }
+        }
+        payload_store(const self& rhs) = delete;
+        payload_store(self&& rhs) noexcept = delete;
+        ~payload_store() noexcept
+        {
+            ::munmap(_data, _size);
+            ::close(_fd);
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto fd() const { return _fd; }
+        auto data() const -> const char* { return _data; }
+        auto size() const { return _size; }
+        bool contains(std::size_t key) const { return key <= _size; }
+        // offset of the value, spread over the whole store
+        auto offset(std::size_t key) const -> std::size_t
+        {
+            return static_cast<std::size_t>(std::uint64_t(key) * 2654435761u % (_size - key + 1));
+        }
+    };
+
+    inline std::unique_ptr<payload_store> global_payload_store_instance;
+
+    inline void create_global_payload_store()
+    {
+        global_payload_store_instance = std::make_unique<payload_store>(DEMO_STORE_SIZE);
+    }
+
+    inline auto global_payload_store() -> payload_store&
+    {
+        return *global_payload_store_instance;
+    }
+
+}
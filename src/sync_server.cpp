@@ -4,13 +4,22 @@
 #include <mutex>
 #include <numeric>
 #include <random>
+#include <string_view>
 #include <thread>
 #include <vector>
 
+#include "admission.hpp"
 #include "buffer.hpp"
 #include "command_line.hpp"
+#include "memory.hpp"
+#include "metrics.hpp"
+#include "numa.hpp"
+#include "party.hpp"
+#include "protocol.hpp"
+#include "trace.hpp"
 #include "tcp.hpp"
 #include "thread.hpp"
+#include "work.hpp"
 
 namespace
 {
@@ -18,73 +27,145 @@ namespace
     using namespace std::chrono_literals;
     using namespace demo;
 
+    class protocol_error : public std::runtime_error
+    {
+    public: // --- life ---
+        explicit protocol_error()
+            : std::runtime_error("protocol-error")
+        { }
+    };
+
+
     class stream
     {
     private: // --- state ---
         tcp::socket _socket;
         buffer _buffer;
+        std::size_t _zerocopy_threshold;
     public: // --- life ---
-        explicit stream(tcp::socket socket)
-            : _socket(std::move(socket))
-        { }
+        explicit stream(tcp::socket socket, std::size_t zerocopy_threshold)
+            : _socket(std::move(socket)), _zerocopy_threshold(zerocopy_threshold)
+        {
+            if (_zerocopy_threshold) {
+                _socket.enable_zerocopy();
+            }
+        }
     public: // --- operations ---
         auto data() { return _buffer.data(); }
         auto available() const { return _buffer.available(); }
         void drain(std::size_t n) { _buffer.drain(n); }
-        auto getline(const deadline& deadline) -> std::size_t
+        auto blocking() const { return _socket.blocking(); }
+        void set_blocking(const std::chrono::milliseconds& timeout) { _socket.set_blocking(timeout); }
+        template <typename Protocol>
+        auto read_request(Protocol& protocol, const deadline& deadline) -> std::size_t
         {
             std::size_t count = _buffer.available();
             do {
-                auto p = _buffer.data(), q = p + _buffer.available();
-                auto r = std::find(q - count, q, '\n');
-                if (r != q) {
-                    return static_cast<std::size_t>(r - p) + 1;
+                auto size = protocol.frame(_buffer.data(), _buffer.available(), _buffer.available() - count);
+                if (size == protocol::invalid) {
+                    throw protocol_error();
+                } else if (size != protocol::incomplete) {
+                    return size;
                 }
             } while ((count = _read_some(1500, deadline)));
             return 0;
         }
+        void write_response(const protocol::response& response, const deadline& deadline)
+        {
+            if (response._fd != -1) {
+                write_file(response._fd, response._offset, response._size, deadline);
+            } else {
+                write_n(response._data, response._size, deadline);
+            }
+        }
+        void write_file(int fd, std::size_t offset, std::size_t size, const deadline& deadline)
+        {
+            for (std::size_t n = 0; n != size; ) {
+                n += _socket.sendfile_some(fd, offset + n, size - n, deadline);
+            }
+        }
         void write_n(const char* data, std::size_t size, const deadline& deadline)
         {
+            bool zerocopy = _zerocopy_threshold && size >= _zerocopy_threshold;
             for (std::size_t n = 0; n != size; ) {
-                n += _socket.send_some(data + n, size - n, deadline);
+                n += _socket.send_some(data + n, size - n, deadline, zerocopy);
+            }
+            if (zerocopy) {
+                _socket.await_zerocopy(deadline);
             }
         }
     private:
         auto _read_some(std::size_t min_size, const deadline& deadline) -> std::size_t
         {
             _buffer.reserve(min_size);
+            DEMO_TRACE_EVENT(read, begin, this, _buffer.available());
             auto n = _socket.recv_some(_buffer.next(), _buffer.reserve(), deadline);
+            DEMO_TRACE_EVENT(read, end, this, n);
+            global_server_metrics.add(server_metrics::bytes_in, n);
             _buffer.advance(n);
             return n;
         }
     };
 
 
+    template <typename Protocol>
     class session
     {
     private: // --- state ---
         stream _stream;
+        Protocol _protocol;
+        party& _party;
+        const simulated_work& _work;
     public: // --- life ---
-        explicit session(tcp::socket socket)
-            : _stream(std::move(socket))
+        explicit session(tcp::socket socket, std::chrono::microseconds busy_poll, std::size_t zerocopy_threshold, bool blocking_io, party& party, const simulated_work& work)
+            : _stream(std::move(socket), zerocopy_threshold), _party(party), _work(work)
+        {
+            global_server_metrics.add(server_metrics::sessions);
+            memory_add(memory_category::sessions, sizeof(*this));
+            memory_add(memory_category::stacks, thread_stack_size());
+            _run(busy_poll, blocking_io);
+        }
+        ~session() noexcept
         {
-            _run();
+            memory_sub(memory_category::stacks, thread_stack_size());
+            memory_sub(memory_category::sessions, sizeof(*this));
+            global_server_metrics.sub(server_metrics::sessions);
         }
     private: // --- operations ---
-        void _run()
+        void _run(std::chrono::microseconds busy_poll, bool blocking_io)
         {
             try {
                 auto timeout = 300s;
-                deadline deadline(timeout);
-                while (auto length = _stream.getline(deadline)) {
-                    auto data = _stream.data();
-                    std::reverse(data, data + length - 1);
-                    _stream.write_n(data, length, deadline);
+                if (blocking_io) {
+                    _stream.set_blocking(timeout);
+                }
+                deadline deadline(timeout, busy_poll);
+                for (;;) {
+                    DEMO_TRACE_EVENT(request, begin, &_stream, 0);
+                    auto length = _stream.read_request(_protocol, deadline);
+                    DEMO_TRACE_EVENT(request, end, &_stream, length);
+                    if (!length) {
+                        break;
+                    }
+                    _party.await();
+                    auto start = std::chrono::steady_clock::now();
+                    DEMO_TRACE_EVENT(process, begin, &_stream, length);
+                    _work(_stream.data(), length);
+                    auto response = _protocol.process(_stream.data(), length);
+                    DEMO_TRACE_EVENT(process, end, &_stream, response._size);
+                    DEMO_TRACE_EVENT(write, begin, &_stream, response._size);
+                    _stream.write_response(response, deadline);
+                    DEMO_TRACE_EVENT(write, end, &_stream, response._size);
+                    global_server_metrics.add(server_metrics::requests);
+                    global_server_metrics.add(server_metrics::bytes_out, response._size);
+                    global_server_metrics.latency(std::chrono::steady_clock::now() - start);
                     _stream.drain(length);
-                    deadline.expires_from_now(timeout);
+                    if (!_stream.blocking()) {
+                        deadline.expires_from_now(timeout);
+                    }
                 }
                 if (_stream.available()) {
-                    throw std::runtime_error("protocol-error");
+                    throw protocol_error();
                 }
             } catch (...) {
                 _handle_error();
@@ -94,6 +175,12 @@ namespace
         {
             try {
                 throw;
+            } catch (const tcp_timeout_error& e) {
+                global_server_metrics.add(server_metrics::timeouts);
+                std::cerr << "EXCEPTION: " << e.what() << std::endl;
+            } catch (const protocol_error& e) {
+                global_server_metrics.add(server_metrics::protocol_errors);
+                std::cerr << "EXCEPTION: " << e.what() << std::endl;
             } catch (const std::exception& e) {
                 std::cerr << "EXCEPTION: " << e.what() << std::endl;
             } catch (...) {
@@ -130,13 +217,25 @@ namespace
 
 
     [[noreturn]]
-    void worker(queue& queue, unsigned short port, const std::vector<int>& cpus)
+    void worker(queue& queue, const std::string& address, const std::vector<int>& cpus, admission& admission, std::string_view busy)
     {
         thread_affinity(cpus);
-        tcp::acceptor acceptor(port, 1 << 14);
+        tcp::acceptor acceptor(address, 1 << 14);
         deadline deadline(3600s);
+        auto reserved = admission.policy() == overload_policy::pause;
         for (;;) {
-            queue.push(tcp::socket(acceptor, deadline));
+            if (reserved) {
+                admission.await_connection();
+            }
+            tcp::socket socket(acceptor, deadline);
+            if (!reserved && !admission.reserve()) {
+                admission::refuse(socket.get_native_handle(), busy);
+                global_server_metrics.add(server_metrics::rejects);
+                continue;
+            }
+            global_server_metrics.add(server_metrics::accepts);
+            DEMO_TRACE_EVENT(accept, instant, &acceptor, socket.get_native_handle());
+            queue.push(std::move(socket));
         }
     }
 
@@ -148,29 +247,104 @@ int main(int argc, char* argv[])
     try {
         std::ios::sync_with_stdio(false);
         // command line arguments
-        std::vector<unsigned short> ports{9999};
+        std::vector<std::string> addresses{"9999"};
         std::vector<int> cpus(std::thread::hardware_concurrency());
         std::iota(cpus.begin(), cpus.end(), 0);
+        bool numa_aware = false;
+        std::size_t busy_poll_us = 0;
+        std::size_t zerocopy_threshold = 10240;
+        bool blocking_io = false;
+        std::string protocol_name{protocol::line_reverse::name};
+        std::size_t party_size = 0;
+        std::string work_spec;
+        std::size_t max_connections = 0;
+        std::string policy = "pause";
         parse_command_line(std::cout, argc - 1, argv + 1,
-            "local-ports", ports,
-            "cpu-set", cpus);
+            "local-ports", addresses,
+            "cpu-set", cpus,
+            "numa-aware", numa_aware,
+            "busy-poll-us", busy_poll_us,
+            "zerocopy-threshold", zerocopy_threshold,
+            "blocking-io", blocking_io,
+            "protocol", protocol_name,
+            "party-size", party_size,
+            "work", work_spec,
+            "max-connections", max_connections,
+            "overload-policy", policy);
+        auto busy_poll = std::chrono::microseconds(busy_poll_us);
         // run
+        if (protocol::uses_payload_store(protocol_name)) {
+            create_global_payload_store();
+        }
         queue queue;
+        admission admission(max_connections, 0, parse_overload_policy(policy));
+        std::string_view busy;
+        protocol::with_protocol(protocol_name, [&busy](auto protocol [[maybe_unused]]) {
+            busy = decltype(protocol)::busy;
+        });
         std::vector<std::thread> threads;
-        for (auto&& port : ports) {
-            threads.emplace_back(worker, std::ref(queue), port, cpus);
+        for (auto&& address : addresses) {
+            threads.emplace_back(worker, std::ref(queue), address, cpus, std::ref(admission), busy);
         }
-        std::mt19937 random(std::random_device{}());
-        std::uniform_int_distribution<std::size_t> dist(0, cpus.size() - 1);
-        for (;;) {
-            for (auto&& socket : queue.pop()) {
-                auto cpu = cpus[dist(random)];
-                std::thread([cpu,socket=std::move(socket)]() mutable {
-                        thread_affinity({cpu});
-                        session(std::move(socket));
-                    }).detach();
-            }
+        numa_topology topology;
+        numa_placement placement(topology.node_count());
+        std::vector<std::vector<int>> node_cpus(topology.node_count());
+        for (auto&& cpu : cpus) {
+            node_cpus[topology.node_of(cpu)].push_back(cpu);
         }
+        party party(party_size);
+        simulated_work work(work_spec);
+        std::thread([&placement,&party,numa_aware,busy_poll_us] {
+                for (;;) {
+                    std::this_thread::sleep_for(5s);
+                    auto now = std::chrono::system_clock::now().time_since_epoch();
+                    auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(now).count();
+                    global_server_metrics.print(std::cout, timestamp);
+                    trace_flush(std::cout, timestamp);
+                    memory_flush(std::cout, timestamp, global_server_metrics.value(server_metrics::sessions));
+                    if (numa_aware) {
+                        placement.print(std::cout, timestamp);
+                    }
+                    if (busy_poll_us) {
+                        global_busy_poll_stats.print(std::cout, timestamp);
+                    }
+                    if (party.size()) {
+                        party.print(std::cout, timestamp);
+                    }
+                }
+            }).detach();
+        protocol::with_protocol(protocol_name, [&](auto protocol [[maybe_unused]]) {
+            using protocol_type = decltype(protocol);
+            std::mt19937 random(std::random_device{}());
+            std::uniform_int_distribution<std::size_t> dist(0, cpus.size() - 1);
+            for (;;) {
+                for (auto&& socket : queue.pop()) {
+                    auto cpu = cpus[dist(random)];
+                    if (numa_aware) {
+                        // serve the connection on the node that received it
+                        auto incoming_cpu = get_incoming_cpu(socket.get_native_handle());
+                        auto node = topology.node_of(incoming_cpu);
+                        auto&& candidates = node_cpus[node];
+                        if (incoming_cpu < 0) {
+                            placement.record(topology.node_of(cpu), numa_origin::unknown);
+                        } else if (candidates.empty()) {
+                            placement.record(topology.node_of(cpu), numa_origin::foreign);
+                        } else {
+                            cpu = candidates[dist(random) % candidates.size()];
+                            placement.record(node, numa_origin::local);
+                        }
+                    }
+                    if (busy_poll_us && !set_busy_poll(socket.get_native_handle(), busy_poll)) {
+                        std::cerr << "WARN: socket busy-poll failed" << std::endl;
+                    }
+                    std::thread([cpu,busy_poll,zerocopy_threshold,blocking_io,&party,&work,&admission,socket=std::move(socket)]() mutable {
+                            thread_affinity({cpu});
+                            session<protocol_type>(std::move(socket), busy_poll, zerocopy_threshold, blocking_io, party, work);
+                            admission.release();
+                        }).detach();
+                }
+            }
+        });
 
     } catch (const std::exception& e) {
         std::cerr << "ERROR: " << e.what() << "\n";
@@ -1,19 +1,41 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
+
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <poll.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include "address.hpp"
+#include "busy_poll.hpp"
+#include "zerocopy.hpp"
+
 namespace demo
 {
 
+    // thrown by the blocking operations when their deadline expires
+    class tcp_timeout_error : public std::runtime_error
+    {
+    public: // --- life ---
+        explicit tcp_timeout_error()
+            : std::runtime_error("tcp-timeout")
+        { }
+    };
+
+
     class deadline
     {
     private: // --- scope ---
@@ -23,12 +45,14 @@ namespace demo
         using duration = std::chrono::nanoseconds;
     private: // --- state ---
         int _fd = -1;
+        duration _spin{0};
     public: // --- life ---
-        explicit deadline(const duration& duration)
+        explicit deadline(const duration& timeout, const duration& spin = duration::zero())
             : deadline()
         {
+            _spin = spin;
             _init_aux();
-            _expires_from_now_aux(duration);
+            _expires_from_now_aux(timeout);
         }
         deadline(const self& rhs) = delete;
         deadline(self&& rhs) noexcept
@@ -54,6 +78,7 @@ namespace demo
         void swap(self& rhs) noexcept
         {
             std::swap(_fd, rhs._fd);
+            std::swap(_spin, rhs._spin);
         }
         friend void swap(self& lhs, self& rhs) noexcept
         {
@@ -62,9 +87,16 @@ namespace demo
         void wait(int fd, short events) const
         {
             pollfd fds[] = {{fd, events, 0}, {_fd, POLLIN, 0}};
+            // spin with non-blocking ppoll until the budget is exhausted
+            const timespec zero = {0, 0};
+            bool spinning = _spin.count() > 0;
+            auto until = steady_clock::now() + _spin;
             for (;;) {
-                int rv = ::ppoll(fds, 2, nullptr, nullptr);
+                int rv = ::ppoll(fds, 2, spinning ? &zero : nullptr, nullptr);
                 if (rv > 0) {
+                    if (spinning) {
+                        global_busy_poll_stats.hit();
+                    }
                     constexpr auto valid = POLLIN | POLLOUT | POLLHUP | POLLERR;
                     if (fds[0].revents & ~valid) {
                         throw std::runtime_error("tcp-poll-error");
@@ -73,10 +105,15 @@ namespace demo
                     } else if (fds[0].revents & valid) {
                         return;
                     } else if (fds[1].revents & valid) {
-                        throw std::runtime_error("tcp-timeout");
+                        throw tcp_timeout_error();
                     } else {
                         throw std::runtime_error("tcp-poll-error");
                     }
+                } else if (rv == 0 && spinning) {
+                    if (steady_clock::now() >= until) {
+                        global_busy_poll_stats.miss();
+                        spinning = false;
+                    }
                 } else if (rv == 0) {
                     throw std::runtime_error("tcp-poll-error");
                 } else if (errno == EINTR) {
@@ -156,11 +193,28 @@ namespace demo
             sa.sin_family = AF_INET;
             sa.sin_port = htons(port);
             sa.sin_addr.s_addr = htonl(INADDR_ANY);
-            if (::bind(_fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0) {
-                throw std::runtime_error("tcp-bind-error");
-            }
-            if (::listen(_fd, backlog) != 0) {
-                throw std::runtime_error("tcp-listen-error");
+            _listen(reinterpret_cast<sockaddr*>(&sa), sizeof(sa), backlog);
+        }
+        explicit acceptor(std::string_view address, int backlog)
+            : acceptor()
+        {
+            if (!is_unix_address(address)) {
+                *this = acceptor(tcp_port(address), backlog);
+            } else {
+                auto path = unix_path(address);
+                sockaddr_un sa = {};
+                if (path.empty() || path.size() >= sizeof(sa.sun_path)) {
+                    throw std::runtime_error("tcp-address-error");
+                }
+                sa.sun_family = AF_UNIX;
+                std::copy(path.begin(), path.end(), sa.sun_path);
+                _fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+                if (_fd == -1) {
+                    throw std::runtime_error("tcp-socket-error");
+                }
+                unix_unlink(path);
+                _listen(reinterpret_cast<sockaddr*>(&sa),
+                    static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + (path[0] != '\0')), backlog);
             }
         }
         acceptor(const self& rhs) = delete;
@@ -196,6 +250,16 @@ namespace demo
         {
             return _fd;
         }
+    private:
+        void _listen(const sockaddr* sa, socklen_t length, int backlog)
+        {
+            if (::bind(_fd, sa, length) != 0) {
+                throw std::runtime_error("tcp-bind-error");
+            }
+            if (::listen(_fd, backlog) != 0) {
+                throw std::runtime_error("tcp-listen-error");
+            }
+        }
     };
 
 
@@ -204,10 +268,14 @@ namespace demo
     private: // --- scope ---
         using self = socket;
     private: // --- state ---
-        sockaddr_in _peer;
+        sockaddr_storage _peer;
         int _fd = -1;
         bool _wait_recv = false;
         bool _wait_send = false;
+        bool _zerocopy = false;
+        zerocopy_tracker _zerocopy_tracker;
+        bool _blocking = false;
+        std::chrono::milliseconds _timeout{0};
     public: // --- life ---
         explicit socket(acceptor& acceptor, deadline& deadline)
             : socket()
@@ -218,7 +286,9 @@ namespace demo
                 _fd = ::accept4(acceptor.get_native_handle(),
                     reinterpret_cast<sockaddr*>(&_peer), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
                 if (_fd != -1) {
-                    setsockopt_aux(_fd, IPPROTO_TCP, TCP_NODELAY, int(1));
+                    if (_peer.ss_family != AF_UNIX) {
+                        setsockopt_aux(_fd, IPPROTO_TCP, TCP_NODELAY, int(1));
+                    }
                     break;
                 } else if (!waited && (errno == EAGAIN || errno == EWOULDBLOCK)) {
                     deadline.wait(acceptor.get_native_handle(), POLLIN);
@@ -257,14 +327,43 @@ namespace demo
             std::swap(_fd, rhs._fd);
             std::swap(_wait_recv, rhs._wait_recv);
             std::swap(_wait_send, rhs._wait_send);
+            std::swap(_zerocopy, rhs._zerocopy);
+            std::swap(_zerocopy_tracker, rhs._zerocopy_tracker);
+            std::swap(_blocking, rhs._blocking);
+            std::swap(_timeout, rhs._timeout);
         }
         friend void swap(self& lhs, self& rhs) noexcept
         {
             lhs.swap(rhs);
         }
+        auto get_native_handle() -> int
+        {
+            return _fd;
+        }
+        auto zerocopy() const { return _zerocopy; }
+        auto blocking() const { return _blocking; }
+        // the deadlines of the operations are ignored afterwards
+        void set_blocking(const std::chrono::milliseconds& timeout)
+        {
+            int flags = ::fcntl(_fd, F_GETFL);
+            if (flags == -1 || ::fcntl(_fd, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+                throw std::runtime_error("tcp-fcntl-error");
+            }
+            auto s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(timeout - s);
+            timeval tv = {s.count(), us.count()};
+            setsockopt_aux(_fd, SOL_SOCKET, SO_RCVTIMEO, tv);
+            setsockopt_aux(_fd, SOL_SOCKET, SO_SNDTIMEO, tv);
+            _blocking = true;
+            _timeout = timeout;
+        }
+        void enable_zerocopy()
+        {
+            _zerocopy = demo::enable_zerocopy(_fd);
+        }
         auto recv_some(char* data, std::size_t size, const deadline& deadline) -> std::size_t
         {
-            if (_wait_recv) {
+            if (_wait_recv && !_blocking) {
                 deadline.wait(_fd, POLLIN);
             }
             for (;;) {
@@ -272,30 +371,98 @@ namespace demo
                 if (rv != -1) {
                     _wait_recv = std::size_t(rv) < size;
                     return static_cast<std::size_t>(rv);
+                } else if (_blocking && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    throw tcp_timeout_error();
                 } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
                     deadline.wait(_fd, POLLIN);
+                } else if (_blocking && errno == EINTR) {
+                    // restart
                 } else {
                     throw std::runtime_error("tcp-send-error");
                 }
             }
         }
-        auto send_some(const char* data, std::size_t size, const deadline& deadline) -> std::size_t
+        auto send_some(const char* data, std::size_t size, const deadline& deadline, bool zerocopy = false) -> std::size_t
         {
-            if (_wait_send) {
+            if (_wait_send && !_blocking) {
                 deadline.wait(_fd, POLLOUT);
             }
+            int flags = MSG_NOSIGNAL | (zerocopy && _zerocopy ? MSG_ZEROCOPY : 0);
             for (;;) {
-                ssize_t rv = ::send(_fd, data, size, MSG_NOSIGNAL);
+                ssize_t rv = ::send(_fd, data, size, flags);
                 if (rv != -1) {
+                    if (flags & MSG_ZEROCOPY) {
+                        _zerocopy_tracker.sent();
+                    }
                     _wait_send = std::size_t(rv) < size;
                     return static_cast<std::size_t>(rv);
+                } else if (_blocking && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    throw tcp_timeout_error();
                 } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
                     deadline.wait(_fd, POLLOUT);
+                } else if (_blocking && errno == EINTR) {
+                    // restart
+                } else if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                    // optmem limit reached: fall back to copying
+                    flags &= ~MSG_ZEROCOPY;
                 } else {
                     throw std::runtime_error("tcp-send-error");
                 }
             }
         }
+        auto sendfile_some(int fd, std::size_t offset, std::size_t size, const deadline& deadline) -> std::size_t
+        {
+            if (_wait_send && !_blocking) {
+                deadline.wait(_fd, POLLOUT);
+            }
+            for (;;) {
+                auto position = static_cast<off_t>(offset);
+                ssize_t rv = ::sendfile(_fd, fd, &position, size);
+                if (rv != -1) {
+                    _wait_send = std::size_t(rv) < size;
+                    return static_cast<std::size_t>(rv);
+                } else if (_blocking && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    throw tcp_timeout_error();
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    deadline.wait(_fd, POLLOUT);
+                } else if (errno == EINTR) {
+                    // restart
+                } else {
+                    throw std::runtime_error("tcp-sendfile-error");
+                }
+            }
+        }
+        void await_zerocopy(const deadline& deadline)
+        {
+            for (;;) {
+                if (!_zerocopy_tracker.poll(_fd)) {
+                    throw std::runtime_error("tcp-zerocopy-error");
+                } else if (!_zerocopy_tracker.pending()) {
+                    return;
+                } else if (_blocking) {
+                    _wait_blocking(0);
+                } else {
+                    deadline.wait(_fd, 0);
+                }
+            }
+        }
+    private:
+        void _wait_blocking(short events)
+        {
+            pollfd fds[] = {{_fd, events, 0}};
+            for (;;) {
+                int rv = ::poll(fds, 1, static_cast<int>(_timeout.count()));
+                if (rv > 0) {
+                    return;
+                } else if (rv == 0) {
+                    throw tcp_timeout_error();
+                } else if (errno == EINTR) {
+                    // restart
+                } else {
+                    throw std::runtime_error("tcp-poll-error");
+                }
+            }
+        }
     };
 
 }
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include <sched.h>
+#include <sys/sysinfo.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// event tracing for the request path, enabled with -DDEMO_TRACE
+
+#ifndef DEMO_TRACE_FILE
+#define DEMO_TRACE_FILE "trace.bin"
+#endif
+
+#ifndef DEMO_TRACE_RING_SIZE
+#define DEMO_TRACE_RING_SIZE (1 << 16)
+#endif
+
+namespace demo
+{
+
+    enum class trace_event : std::uint8_t
+    {
+        accept,
+        read,
+        request,
+        process,
+        write,
+    };
+
+    enum class trace_phase : std::uint8_t
+    {
+        begin,
+        end,
+        instant,
+    };
+
+    inline auto trace_event_name(std::uint8_t event) -> const char*
+    {
+        static const char* const names[] = {"accept", "read", "request", "process", "write"};
+        return event < std::size(names) ? names[event] : "unknown";
+    }
+
+    inline auto trace_clock() -> std::uint64_t
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+
+    // on-disk layout of a single event
+    struct trace_record
+    {
+        std::uint64_t _tsc;
+        std::uint64_t _id;
+        std::uint32_t _arg;
+        std::uint16_t _cpu;
+        std::uint8_t _event;
+        std::uint8_t _phase;
+    };
+    static_assert(sizeof(trace_record) == 24);
+
+    // on-disk header in front of the records of each dump
+    struct trace_chunk
+    {
+        static constexpr std::uint32_t magic = 0x54524344; // "DCRT"
+        std::uint32_t _magic;
+        std::uint32_t _count;
+        std::uint64_t _base;
+        double _ticks_per_us;
+    };
+    static_assert(sizeof(trace_chunk) == 24);
+
+
+    class tracer
+    {
+    private: // --- scope ---
+        using self = tracer;
+        using steady_clock = std::chrono::steady_clock;
+        static constexpr std::uint64_t capacity = DEMO_TRACE_RING_SIZE;
+        static_assert((capacity & (capacity - 1)) == 0);
+        struct slot
+        {
+            std::atomic<std::uint64_t> _seq{0};
+            std::atomic<std::uint64_t> _tsc{0};
+            std::atomic<std::uint64_t> _id{0};
+            std::atomic<std::uint64_t> _meta{0};
+        };
+        struct alignas(64) ring
+        {
+            std::atomic<std::uint64_t> _head{0};
+            std::uint64_t _tail = 0;
+            std::unique_ptr<slot[]> _slots = std::make_unique<slot[]>(capacity);
+        };
+    private: // --- state ---
+        std::size_t _size;
+        std::unique_ptr<ring[]> _rings;
+        std::uint64_t _base = trace_clock();
+        steady_clock::time_point _start = steady_clock::now();
+        std::FILE* _file = nullptr;
+    public: // --- life ---
+        explicit tracer()
+            : _size(static_cast<std::size_t>(std::max(::get_nprocs_conf(), 1)))
+            , _rings(std::make_unique<ring[]>(_size))
+        { }
+        tracer(const self& rhs) = delete;
+        tracer(self&& rhs) noexcept = delete;
+        ~tracer() noexcept
+        {
+            if (_file) {
+                std::fclose(_file);
+            }
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        void record(trace_event event, trace_phase phase, const void* id, std::uint32_t arg)
+        {
+            thread_local std::size_t cpu = static_cast<std::size_t>(std::max(::sched_getcpu(), 0));
+            auto&& ring = _rings[cpu % _size];
+            auto index = ring._head.fetch_add(1, std::memory_order_relaxed);
+            auto&& slot = ring._slots[index & (capacity - 1)];
+            slot._seq.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot._tsc.store(trace_clock(), std::memory_order_relaxed);
+            slot._id.store(reinterpret_cast<std::uintptr_t>(id), std::memory_order_relaxed);
+            slot._meta.store(std::uint64_t(arg) << 32
+                | std::uint64_t(cpu % _size) << 16
+                | std::uint64_t(event) << 8
+                | std::uint64_t(phase), std::memory_order_relaxed);
+            slot._seq.store(index + 1, std::memory_order_release);
+        }
+        void dump(std::ostream& os, long long timestamp)
+        {
+            std::vector<trace_record> records;
+            std::size_t drops = 0;
+            for (std::size_t i = 0; i != _size; ++i) {
+                auto&& ring = _rings[i];
+                auto head = ring._head.load(std::memory_order_acquire);
+                auto from = std::max(ring._tail, head > capacity ? head - capacity : 0);
+                drops += from - ring._tail;
+                for (auto index = from; index != head; ++index) {
+                    auto&& slot = ring._slots[index & (capacity - 1)];
+                    auto seq = slot._seq.load(std::memory_order_acquire);
+                    trace_record record;
+                    record._tsc = slot._tsc.load(std::memory_order_relaxed);
+                    record._id = slot._id.load(std::memory_order_relaxed);
+                    auto meta = slot._meta.load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (seq != index + 1 || slot._seq.load(std::memory_order_relaxed) != seq) {
+                        ++drops;
+                        continue;
+                    }
+                    record._arg = static_cast<std::uint32_t>(meta >> 32);
+                    record._cpu = static_cast<std::uint16_t>(meta >> 16);
+                    record._event = static_cast<std::uint8_t>(meta >> 8);
+                    record._phase = static_cast<std::uint8_t>(meta);
+                    records.push_back(record);
+                }
+                ring._tail = head;
+            }
+            auto elapsed = std::chrono::duration<double, std::micro>(steady_clock::now() - _start).count();
+            trace_chunk chunk{trace_chunk::magic, static_cast<std::uint32_t>(records.size()), _base,
+                elapsed > 0 ? double(trace_clock() - _base) / elapsed : 1.0};
+            if (!_file && !(_file = std::fopen(DEMO_TRACE_FILE, "wb"))) {
+                throw std::runtime_error("trace-open-error");
+            }
+            if (std::fwrite(&chunk, sizeof(chunk), 1, _file) != 1
+                || std::fwrite(records.data(), sizeof(trace_record), records.size(), _file) != records.size()
+                || std::fflush(_file) != 0) {
+                throw std::runtime_error("trace-write-error");
+            }
+            os << "TRACE: " << timestamp << " " << records.size() << " " << drops << std::endl;
+        }
+    };
+
+}
+
+#ifdef DEMO_TRACE
+
+namespace demo
+{
+    inline tracer global_tracer;
+    inline void trace_flush(std::ostream& os, long long timestamp) { global_tracer.dump(os, timestamp); }
+}
+
+#define DEMO_TRACE_EVENT(event, phase, id, arg) \
+    do { ::demo::global_tracer.record(::demo::trace_event::event, ::demo::trace_phase::phase, id, static_cast<std::uint32_t>(arg)); } while (false)
+
+#else
+
+namespace demo
+{
+    inline void trace_flush(std::ostream& os [[maybe_unused]], long long timestamp [[maybe_unused]]) { }
+}
+
+#define DEMO_TRACE_EVENT(event, phase, id, arg) \
+    do { } while (false)
+
+#endif
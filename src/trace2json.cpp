@@ -0,0 +1,63 @@
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "command_line.hpp"
+#include "trace.hpp"
+
+namespace
+{
+
+    using namespace demo;
+
+    void convert(std::FILE* input, std::ostream& os)
+    {
+        os << "{\"traceEvents\":[";
+        const char* separator = "\n";
+        trace_chunk chunk;
+        std::vector<trace_record> records;
+        while (std::fread(&chunk, sizeof(chunk), 1, input) == 1) {
+            if (chunk._magic != trace_chunk::magic) {
+                throw std::runtime_error("trace-format-error");
+            }
+            records.resize(chunk._count);
+            if (std::fread(records.data(), sizeof(trace_record), records.size(), input) != records.size()) {
+                throw std::runtime_error("trace-read-error");
+            }
+            for (auto&& record : records) {
+                static const char* const phases[] = {"b", "e", "n"};
+                auto ts = double(record._tsc - chunk._base) / chunk._ticks_per_us;
+                os << separator
+                   << "{\"name\":\"" << trace_event_name(record._event)
+                   << "\",\"cat\":\"demo\",\"ph\":\"" << phases[record._phase % 3]
+                   << "\",\"id\":\"0x" << std::hex << record._id << std::dec
+                   << "\",\"ts\":" << std::fixed << ts
+                   << ",\"pid\":0,\"tid\":" << record._cpu
+                   << ",\"args\":{\"arg\":" << record._arg << "}}";
+                separator = ",\n";
+            }
+        }
+        os << "\n]}\n";
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    try {
+        std::ios::sync_with_stdio(false);
+        // command line arguments
+        std::string input = DEMO_TRACE_FILE;
+        parse_command_line(std::cerr, argc - 1, argv + 1,
+            "input", input);
+        // run
+        std::unique_ptr<std::FILE, int(*)(std::FILE*)> file(std::fopen(input.c_str(), "rb"), &std::fclose);
+        if (!file) {
+            throw std::runtime_error("trace-open-error");
+        }
+        convert(file.get(), std::cout);
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
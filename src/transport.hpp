@@ -0,0 +1,861 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "boost/asio.hpp"
+
+#ifndef IP_BIND_ADDRESS_NO_PORT
+#define IP_BIND_ADDRESS_NO_PORT 24
+#endif
+
+namespace demo
+{
+
+    namespace asio = boost::asio;
+
+    // all of them complete on the io_service of the client thread
+    enum class io_backend { asio, epoll, io_uring };
+
+    inline auto parse_io_backend(std::string_view name) -> io_backend
+    {
+        if (name == "asio") {
+            return io_backend::asio;
+        } else if (name == "epoll") {
+            return io_backend::epoll;
+        } else if (name == "io-uring") {
+            return io_backend::io_uring;
+        } else {
+            throw std::runtime_error("io-backend-error");
+        }
+    }
+
+
+    inline auto errno_code() -> boost::system::error_code
+    {
+        return boost::system::error_code(errno, boost::system::system_category());
+    }
+
+    // non-blocking socket for the peer
+    inline auto open_socket(const asio::generic::stream_protocol::endpoint& peer, boost::system::error_code& ec) -> int
+    {
+        int fd = ::socket(peer.protocol().family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, peer.protocol().protocol());
+        if (fd == -1) {
+            ec = errno_code();
+        }
+        return fd;
+    }
+
+    inline void bind_socket(int fd, const asio::ip::address& source, boost::system::error_code& ec)
+    {
+        int value = 1;
+        ::setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &value, sizeof(value));
+        asio::ip::tcp::endpoint local(source, 0);
+        if (::bind(fd, local.data(), static_cast<socklen_t>(local.size())) != 0) {
+            ec = errno_code();
+        }
+    }
+
+    inline void set_no_delay(int fd)
+    {
+        int value = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+    }
+
+
+    class asio_transport
+    {
+    private: // --- scope ---
+        using stream_protocol = asio::generic::stream_protocol;
+        using error_code = boost::system::error_code;
+    private: // --- state ---
+        stream_protocol::socket _socket;
+    public: // --- life ---
+        explicit asio_transport(asio::io_service& io_service)
+            : _socket(io_service)
+        { }
+    public: // --- operations ---
+        static void prepare(asio::io_service& io_service [[maybe_unused]], std::size_t connections [[maybe_unused]]) { }
+        void bind(const stream_protocol::endpoint& peer, const asio::ip::address& source, error_code& ec)
+        {
+            _socket.open(peer.protocol(), ec);
+            if (!ec) {
+                bind_socket(_socket.native_handle(), source, ec);
+            }
+        }
+        template <typename Handler>
+        void async_connect(const stream_protocol::endpoint& peer, Handler&& handler)
+        {
+            _socket.async_connect(peer, [this,unix=peer.protocol().family()==AF_UNIX,handler=std::forward<Handler>(handler)](error_code ec) mutable {
+                    if (!ec && !unix) {
+                        _socket.set_option(asio::ip::tcp::no_delay(true));
+                    }
+                    handler(ec);
+                });
+        }
+        template <typename Handler>
+        void async_write(const char* data, std::size_t size, Handler&& handler)
+        {
+            asio::async_write(_socket, asio::buffer(data, size), std::forward<Handler>(handler));
+        }
+        template <typename Handler>
+        void async_read(char* data, std::size_t size, Handler&& handler)
+        {
+            asio::async_read(_socket, asio::buffer(data, size), std::forward<Handler>(handler));
+        }
+        template <typename Handler>
+        void async_read_some(char* data, std::size_t size, Handler&& handler)
+        {
+            _socket.async_read_some(asio::buffer(data, size), std::forward<Handler>(handler));
+        }
+        void shutdown_send(error_code& ec)
+        {
+            _socket.shutdown(stream_protocol::socket::shutdown_send, ec);
+        }
+        void shutdown(error_code& ec)
+        {
+            _socket.shutdown(stream_protocol::socket::shutdown_both, ec);
+        }
+        void close()
+        {
+            error_code ec;
+            _socket.close(ec);
+        }
+    };
+
+
+    class epoll_transport;
+
+    class epoll_reactor : public asio::io_service::service
+    {
+    public: // --- scope ---
+        inline static asio::io_service::id id;
+    private: // --- scope ---
+        using error_code = boost::system::error_code;
+        static constexpr int batch_size = 256;
+    private: // --- state ---
+        asio::posix::stream_descriptor _descriptor;
+        std::size_t _waiting = 0;
+        bool _armed = false;
+    public: // --- life ---
+        explicit epoll_reactor(asio::io_service& io_service)
+            : asio::io_service::service(io_service), _descriptor(io_service, _create())
+        { }
+    public: // --- operations ---
+        void add(int fd, epoll_transport* transport, error_code& ec)
+        {
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.ptr = transport;
+            if (::epoll_ctl(_descriptor.native_handle(), EPOLL_CTL_ADD, fd, &event) != 0) {
+                ec = errno_code();
+            }
+        }
+        void wait()
+        {
+            ++_waiting;
+            if (!_armed) {
+                _poll();
+                _arm();
+            }
+        }
+        void done()
+        {
+            --_waiting;
+        }
+    private:
+        void shutdown_service() { }
+        static auto _create() -> int
+        {
+            int fd = ::epoll_create1(EPOLL_CLOEXEC);
+            if (fd == -1) {
+                throw std::runtime_error("epoll-create-error");
+            }
+            return fd;
+        }
+        void _arm()
+        {
+            if (_armed || _waiting == 0) {
+                return;
+            }
+            _armed = true;
+            _descriptor.async_wait(asio::posix::stream_descriptor::wait_read, [this](error_code ec) {
+                    _armed = false;
+                    if (!ec) {
+                        _poll();
+                        _arm();
+                    }
+                });
+        }
+        void _poll();
+    };
+
+    // edge-triggered, so the transport tracks the readiness itself
+    class epoll_transport
+    {
+        friend class epoll_reactor;
+    private: // --- scope ---
+        using self = epoll_transport;
+        using stream_protocol = asio::generic::stream_protocol;
+        using error_code = boost::system::error_code;
+        // a connect, or a send or receive of all or some bytes
+        class operation
+        {
+        public: // --- state ---
+            char* _data = nullptr;
+            std::size_t _size = 0;
+            std::size_t _done = 0;
+            bool _all = true;
+            std::function<void(error_code, std::size_t)> _handler;
+        };
+    private: // --- state ---
+        asio::io_service& _io_service;
+        epoll_reactor& _reactor;
+        int _fd = -1;
+        bool _no_delay = false;
+        bool _connecting = false;
+        bool _readable = false;
+        bool _writable = false;
+        operation _read;
+        operation _write;
+    public: // --- life ---
+        explicit epoll_transport(asio::io_service& io_service)
+            : _io_service(io_service), _reactor(asio::use_service<epoll_reactor>(io_service))
+        { }
+        epoll_transport(const self& rhs) = delete;
+        // only before the connect, which registers the transport
+        epoll_transport(self&& rhs) noexcept
+            : _io_service(rhs._io_service), _reactor(rhs._reactor), _fd(std::exchange(rhs._fd, -1))
+        { }
+        ~epoll_transport() noexcept
+        {
+            close();
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        static void prepare(asio::io_service& io_service [[maybe_unused]], std::size_t connections [[maybe_unused]]) { }
+        void bind(const stream_protocol::endpoint& peer, const asio::ip::address& source, error_code& ec)
+        {
+            _fd = open_socket(peer, ec);
+            if (!ec) {
+                bind_socket(_fd, source, ec);
+            }
+        }
+        template <typename Handler>
+        void async_connect(const stream_protocol::endpoint& peer, Handler&& handler)
+        {
+            error_code ec;
+            if (_fd == -1) {
+                _fd = open_socket(peer, ec);
+            }
+            if (!ec) {
+                _reactor.add(_fd, this, ec);
+            }
+            if (!ec && ::connect(_fd, peer.data(), static_cast<socklen_t>(peer.size())) != 0 && errno != EINPROGRESS) {
+                ec = errno_code();
+            }
+            if (ec) {
+                _io_service.post([handler=std::forward<Handler>(handler),ec]() mutable { handler(ec); });
+                return;
+            }
+            _no_delay = peer.protocol().family() != AF_UNIX;
+            _connecting = true;
+            _write._handler = [handler=std::forward<Handler>(handler)](error_code ec, std::size_t) mutable { handler(ec); };
+            _reactor.wait();
+        }
+        template <typename Handler>
+        void async_write(const char* data, std::size_t size, Handler&& handler)
+        {
+            _start(_write, _writable, &self::_send, const_cast<char*>(data), size, true, std::forward<Handler>(handler));
+        }
+        template <typename Handler>
+        void async_read(char* data, std::size_t size, Handler&& handler)
+        {
+            _start(_read, _readable, &self::_recv, data, size, true, std::forward<Handler>(handler));
+        }
+        template <typename Handler>
+        void async_read_some(char* data, std::size_t size, Handler&& handler)
+        {
+            _start(_read, _readable, &self::_recv, data, size, false, std::forward<Handler>(handler));
+        }
+        void shutdown_send(error_code& ec)
+        {
+            if (::shutdown(_fd, SHUT_WR) != 0) {
+                ec = errno_code();
+            }
+        }
+        void shutdown(error_code& ec)
+        {
+            if (::shutdown(_fd, SHUT_RDWR) != 0) {
+                ec = errno_code();
+            }
+        }
+        // closing removes the socket from the epoll instance
+        void close()
+        {
+            if (_fd != -1) {
+                ::close(_fd);
+                _fd = -1;
+            }
+            for (auto op : {&_read, &_write}) {
+                if (op->_handler) {
+                    op->_handler = nullptr;
+                    _reactor.done();
+                }
+            }
+            _connecting = _readable = _writable = false;
+        }
+    private:
+        template <typename Handler>
+        void _start(operation& op, bool ready, bool (self::*attempt)(operation&, error_code&), char* data, std::size_t size, bool all, Handler&& handler)
+        {
+            op._data = data;
+            op._size = size;
+            op._done = 0;
+            op._all = all;
+            error_code ec;
+            if (ready && (this->*attempt)(op, ec)) {
+                _io_service.post([handler=std::forward<Handler>(handler),ec,done=op._done]() mutable { handler(ec, done); });
+            } else {
+                op._handler = std::forward<Handler>(handler);
+                _reactor.wait();
+            }
+        }
+        void _on_events(std::uint32_t events)
+        {
+            if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                _writable = true;
+                if (_connecting) {
+                    _finish_connect();
+                } else if (_write._handler) {
+                    _resume(_write, &self::_send);
+                }
+            }
+            if (events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+                _readable = true;
+                if (_read._handler) {
+                    _resume(_read, &self::_recv);
+                }
+            }
+        }
+        void _finish_connect()
+        {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (::getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0) {
+                error = errno;
+            }
+            if (error == 0 && _no_delay) {
+                set_no_delay(_fd);
+            }
+            _connecting = false;
+            _complete(_write, error_code(error, boost::system::system_category()));
+        }
+        void _resume(operation& op, bool (self::*attempt)(operation&, error_code&))
+        {
+            error_code ec;
+            if ((this->*attempt)(op, ec)) {
+                _complete(op, ec);
+            }
+        }
+        void _complete(operation& op, error_code ec)
+        {
+            _reactor.done();
+            _io_service.post([handler=std::move(op._handler),ec,done=op._done]() mutable { handler(ec, done); });
+            op._handler = nullptr;
+        }
+        // returns false, if the socket is no longer ready
+        bool _send(operation& op, error_code& ec)
+        {
+            while (op._done != op._size) {
+                ssize_t rv = ::send(_fd, op._data + op._done, op._size - op._done, MSG_NOSIGNAL);
+                if (rv != -1) {
+                    op._done += static_cast<std::size_t>(rv);
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    _writable = false;
+                    return false;
+                } else if (errno != EINTR) {
+                    ec = errno_code();
+                    break;
+                }
+            }
+            return true;
+        }
+        bool _recv(operation& op, error_code& ec)
+        {
+            while (op._done != op._size) {
+                ssize_t rv = ::recv(_fd, op._data + op._done, op._size - op._done, 0);
+                if (rv > 0) {
+                    op._done += static_cast<std::size_t>(rv);
+                    if (!op._all) {
+                        break;
+                    }
+                } else if (rv == 0) {
+                    ec = asio::error::eof;
+                    break;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    _readable = false;
+                    return false;
+                } else if (errno != EINTR) {
+                    ec = errno_code();
+                    break;
+                }
+            }
+            return true;
+        }
+    };
+
+    inline void epoll_reactor::_poll()
+    {
+        epoll_event events[batch_size];
+        for (;;) {
+            int count = ::epoll_wait(_descriptor.native_handle(), events, batch_size, 0);
+            if (count == -1 && errno == EINTR) {
+                continue;
+            }
+            for (int i = 0; i < count; ++i) {
+                static_cast<epoll_transport*>(events[i].data.ptr)->_on_events(events[i].events);
+            }
+            if (count < batch_size) {
+                return;
+            }
+        }
+    }
+
+
+    // an operation submitted to an uring_reactor
+    class uring_completion
+    {
+    public: // --- operations ---
+        virtual void complete(int result) = 0;
+    protected: // --- life ---
+        ~uring_completion() = default;
+    };
+
+    // the completions that do not fit into the ring are kept by the kernel (IORING_FEAT_NODROP)
+    class uring_reactor : public asio::io_service::service
+    {
+    public: // --- scope ---
+        inline static asio::io_service::id id;
+    private: // --- scope ---
+        using error_code = boost::system::error_code;
+        static constexpr unsigned entries = 4096;
+    private: // --- state ---
+        asio::io_service& _io_service;
+        io_uring_params _params{};
+        int _fd = -1;
+        void* _sq_ring = MAP_FAILED;
+        void* _cq_ring = MAP_FAILED;
+        void* _sqes = MAP_FAILED;
+        std::size_t _sq_ring_size = 0;
+        std::size_t _cq_ring_size = 0;
+        std::size_t _sqes_size = 0;
+        asio::posix::stream_descriptor _eventfd;
+        unsigned _queued = 0;
+        std::size_t _inflight = 0;
+        bool _armed = false;
+        bool _flushing = false;
+    public: // --- life ---
+        explicit uring_reactor(asio::io_service& io_service, std::size_t connections = 0)
+            : asio::io_service::service(io_service), _io_service(io_service), _eventfd(io_service)
+        {
+            _params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+            _params.cq_entries = static_cast<unsigned>(std::max<std::size_t>(entries * 2, connections * 4));
+            _fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &_params));
+            if (_fd == -1) {
+                throw std::runtime_error("uring-setup-error");
+            } else if (!(_params.features & IORING_FEAT_NODROP)) {
+                _release();
+                throw std::runtime_error("uring-nodrop-error");
+            } else if (_params.cq_entries < connections * 2) {
+                _release();
+                throw std::runtime_error("uring-cq-size-error");
+            }
+            _sq_ring_size = _params.sq_off.array + _params.sq_entries * sizeof(unsigned);
+            _cq_ring_size = _params.cq_off.cqes + _params.cq_entries * sizeof(io_uring_cqe);
+            _sqes_size = _params.sq_entries * sizeof(io_uring_sqe);
+            bool single = _params.features & IORING_FEAT_SINGLE_MMAP;
+            if (single) {
+                _sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+            }
+            _sq_ring = _map(_sq_ring_size, IORING_OFF_SQ_RING);
+            _cq_ring = single ? _sq_ring : _map(_cq_ring_size, IORING_OFF_CQ_RING);
+            _sqes = _map(_sqes_size, IORING_OFF_SQES);
+            int eventfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (eventfd == -1) {
+                _release();
+                throw std::runtime_error("uring-eventfd-error");
+            }
+            _eventfd.assign(eventfd);
+            if (::syscall(__NR_io_uring_register, _fd, IORING_REGISTER_EVENTFD, &eventfd, 1) != 0) {
+                _release();
+                throw std::runtime_error("uring-register-error");
+            }
+        }
+        ~uring_reactor() noexcept
+        {
+            _release();
+        }
+    public: // --- operations ---
+        // queues the entry, which is submitted with the current batch
+        void submit(const io_uring_sqe& entry)
+        {
+            while (_queued == _params.sq_entries) {
+                _enter();
+            }
+            auto tail = *_sq_field(_params.sq_off.tail);
+            auto index = tail & *_sq_field(_params.sq_off.ring_mask);
+            static_cast<io_uring_sqe*>(_sqes)[index] = entry;
+            _sq_field(_params.sq_off.array)[index] = index;
+            __atomic_store_n(_sq_field(_params.sq_off.tail), tail + 1, __ATOMIC_RELEASE);
+            ++_queued;
+            ++_inflight;
+            if (!_flushing) {
+                _flushing = true;
+                _io_service.post([this] {
+                        _flushing = false;
+                        _enter();
+                    });
+            }
+        }
+        // cancels the operation, the cancel itself has no completion object
+        void cancel(const uring_completion& completion)
+        {
+            io_uring_sqe entry{};
+            entry.opcode = IORING_OP_ASYNC_CANCEL;
+            entry.fd = -1;
+            entry.addr = reinterpret_cast<std::uintptr_t>(&completion);
+            submit(entry);
+        }
+        template <typename Predicate>
+        void run_until(Predicate&& predicate)
+        {
+            while (!predicate()) {
+                auto rv = ::syscall(__NR_io_uring_enter, _fd, _queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (rv >= 0) {
+                    _queued -= static_cast<unsigned>(rv);
+                } else if (errno != EINTR && errno != EBUSY) {
+                    throw std::runtime_error("uring-enter-error");
+                }
+                _reap();
+            }
+        }
+    private:
+        void shutdown_service() { }
+        auto _map(std::size_t size, std::uint64_t offset) -> void*
+        {
+            auto data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, static_cast<off_t>(offset));
+            if (data == MAP_FAILED) {
+                _release();
+                throw std::runtime_error("uring-mmap-error");
+            }
+            return data;
+        }
+        void _release()
+        {
+            if (_sqes != MAP_FAILED) {
+                ::munmap(_sqes, _sqes_size);
+                _sqes = MAP_FAILED;
+            }
+            if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring) {
+                ::munmap(_cq_ring, _cq_ring_size);
+            }
+            _cq_ring = MAP_FAILED;
+            if (_sq_ring != MAP_FAILED) {
+                ::munmap(_sq_ring, _sq_ring_size);
+                _sq_ring = MAP_FAILED;
+            }
+            if (_fd != -1) {
+                ::close(_fd);
+                _fd = -1;
+            }
+        }
+        auto _sq_field(std::uint32_t offset) -> unsigned*
+        {
+            return reinterpret_cast<unsigned*>(static_cast<char*>(_sq_ring) + offset);
+        }
+        auto _cq_field(std::uint32_t offset) -> unsigned*
+        {
+            return reinterpret_cast<unsigned*>(static_cast<char*>(_cq_ring) + offset);
+        }
+        void _enter()
+        {
+            while (_queued != 0) {
+                auto rv = ::syscall(__NR_io_uring_enter, _fd, _queued, 0, 0, nullptr, 0);
+                if (rv > 0) {
+                    _queued -= static_cast<unsigned>(rv);
+                } else if (rv == -1 && errno == EBUSY) {
+                    // the kernel holds back completions, make room first
+                    _reap();
+                } else if (rv == -1 && errno != EINTR) {
+                    throw std::runtime_error("uring-enter-error");
+                }
+            }
+            _arm();
+        }
+        void _arm()
+        {
+            if (_armed || _inflight == 0) {
+                return;
+            }
+            _armed = true;
+            _eventfd.async_wait(asio::posix::stream_descriptor::wait_read, [this](error_code ec) {
+                    _armed = false;
+                    if (!ec) {
+                        _reap();
+                        _arm();
+                    }
+                });
+        }
+        // the head is read for every entry, since a handler may reap in turn
+        void _reap()
+        {
+            std::uint64_t value;
+            [[maybe_unused]] auto rv = ::read(_eventfd.native_handle(), &value, sizeof(value));
+            auto head_field = _cq_field(_params.cq_off.head);
+            auto tail_field = _cq_field(_params.cq_off.tail);
+            auto mask = *_cq_field(_params.cq_off.ring_mask);
+            auto cqes = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(_cq_ring) + _params.cq_off.cqes);
+            for (;;) {
+                auto head = *head_field;
+                if (head == __atomic_load_n(tail_field, __ATOMIC_ACQUIRE)) {
+                    if (!(__atomic_load_n(_sq_field(_params.sq_off.flags), __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)) {
+                        return;
+                    }
+                    ::syscall(__NR_io_uring_enter, _fd, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+                    continue;
+                }
+                auto&& cqe = cqes[head & mask];
+                auto completion = reinterpret_cast<uring_completion*>(cqe.user_data);
+                auto result = cqe.res;
+                __atomic_store_n(head_field, head + 1, __ATOMIC_RELEASE);
+                --_inflight;
+                if (completion) {
+                    completion->complete(result);
+                }
+            }
+        }
+    };
+
+    class uring_transport
+    {
+    private: // --- scope ---
+        using self = uring_transport;
+        using stream_protocol = asio::generic::stream_protocol;
+        using error_code = boost::system::error_code;
+        class operation : public uring_completion
+        {
+        public: // --- state ---
+            uring_transport* _owner;
+            std::uint8_t _opcode = IORING_OP_NOP;
+            char* _data = nullptr;
+            std::size_t _size = 0;
+            std::size_t _done = 0;
+            bool _all = true;
+            bool _inflight = false;
+            std::function<void(error_code, std::size_t)> _handler;
+        public: // --- life ---
+            explicit operation(uring_transport* owner)
+                : _owner(owner)
+            { }
+        public: // --- operations ---
+            void complete(int result) override
+            {
+                _owner->_complete(*this, result);
+            }
+        };
+    private: // --- state ---
+        asio::io_service& _io_service;
+        uring_reactor& _reactor;
+        int _fd = -1;
+        bool _no_delay = false;
+        stream_protocol::endpoint _peer;
+        operation _read{this};
+        operation _write{this};
+    public: // --- life ---
+        explicit uring_transport(asio::io_service& io_service)
+            : _io_service(io_service), _reactor(asio::use_service<uring_reactor>(io_service))
+        { }
+        uring_transport(const self& rhs) = delete;
+        // only before the first operation, which refers to the transport
+        uring_transport(self&& rhs) noexcept
+            : _io_service(rhs._io_service), _reactor(rhs._reactor), _fd(std::exchange(rhs._fd, -1))
+        { }
+        ~uring_transport() noexcept
+        {
+            close();
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        // sizes the completion ring for the connections
+        static void prepare(asio::io_service& io_service, std::size_t connections)
+        {
+            asio::add_service(io_service, new uring_reactor(io_service, connections));
+        }
+        void bind(const stream_protocol::endpoint& peer, const asio::ip::address& source, error_code& ec)
+        {
+            _fd = open_socket(peer, ec);
+            if (!ec) {
+                bind_socket(_fd, source, ec);
+            }
+        }
+        template <typename Handler>
+        void async_connect(const stream_protocol::endpoint& peer, Handler&& handler)
+        {
+            error_code ec;
+            if (_fd == -1) {
+                _fd = open_socket(peer, ec);
+            }
+            if (ec) {
+                _io_service.post([handler=std::forward<Handler>(handler),ec]() mutable { handler(ec); });
+                return;
+            }
+            _peer = peer;
+            _no_delay = peer.protocol().family() != AF_UNIX;
+            _write._handler = [handler=std::forward<Handler>(handler)](error_code ec, std::size_t) mutable { handler(ec); };
+            _submit(_write, IORING_OP_CONNECT);
+        }
+        template <typename Handler>
+        void async_write(const char* data, std::size_t size, Handler&& handler)
+        {
+            _start(_write, IORING_OP_SEND, const_cast<char*>(data), size, true, std::forward<Handler>(handler));
+        }
+        template <typename Handler>
+        void async_read(char* data, std::size_t size, Handler&& handler)
+        {
+            _start(_read, IORING_OP_RECV, data, size, true, std::forward<Handler>(handler));
+        }
+        template <typename Handler>
+        void async_read_some(char* data, std::size_t size, Handler&& handler)
+        {
+            _start(_read, IORING_OP_RECV, data, size, false, std::forward<Handler>(handler));
+        }
+        void shutdown_send(error_code& ec)
+        {
+            if (::shutdown(_fd, SHUT_WR) != 0) {
+                ec = errno_code();
+            }
+        }
+        void shutdown(error_code& ec)
+        {
+            if (::shutdown(_fd, SHUT_RDWR) != 0) {
+                ec = errno_code();
+            }
+        }
+        // waits for the completions of the cancelled operations, which refer to the transport
+        void close()
+        {
+            if (_fd == -1) {
+                return;
+            }
+            if (_read._inflight || _write._inflight) {
+                for (auto op : {&_read, &_write}) {
+                    op->_handler = nullptr;
+                    if (op->_inflight) {
+                        _reactor.cancel(*op);
+                    }
+                }
+                ::shutdown(_fd, SHUT_RDWR);
+                _reactor.run_until([this] { return !_read._inflight && !_write._inflight; });
+            }
+            ::close(_fd);
+            _fd = -1;
+        }
+    private:
+        template <typename Handler>
+        void _start(operation& op, std::uint8_t opcode, char* data, std::size_t size, bool all, Handler&& handler)
+        {
+            op._data = data;
+            op._size = size;
+            op._done = 0;
+            op._all = all;
+            op._handler = std::forward<Handler>(handler);
+            _submit(op, opcode);
+        }
+        void _submit(operation& op, std::uint8_t opcode)
+        {
+            op._opcode = opcode;
+            op._inflight = true;
+            io_uring_sqe entry{};
+            entry.opcode = opcode;
+            entry.fd = _fd;
+            entry.user_data = reinterpret_cast<std::uintptr_t>(static_cast<uring_completion*>(&op));
+            if (opcode == IORING_OP_CONNECT) {
+                entry.addr = reinterpret_cast<std::uintptr_t>(_peer.data());
+                entry.off = _peer.size();
+            } else {
+                entry.addr = reinterpret_cast<std::uintptr_t>(op._data + op._done);
+                entry.len = static_cast<std::uint32_t>(op._size - op._done);
+                entry.msg_flags = opcode == IORING_OP_SEND ? MSG_NOSIGNAL : 0;
+            }
+            _reactor.submit(entry);
+        }
+        void _complete(operation& op, int result)
+        {
+            op._inflight = false;
+            error_code ec;
+            if (!op._handler) {
+                // cancelled by close
+                return;
+            } else if (result == -EINTR || result == -EAGAIN) {
+                _submit(op, op._opcode);
+                return;
+            } else if (result < 0) {
+                ec = error_code(-result, boost::system::system_category());
+            } else if (op._opcode == IORING_OP_CONNECT) {
+                if (_no_delay) {
+                    set_no_delay(_fd);
+                }
+            } else if (result == 0 && op._opcode == IORING_OP_RECV) {
+                ec = asio::error::eof;
+            } else {
+                op._done += static_cast<std::size_t>(result);
+                if (op._all && op._done != op._size) {
+                    _submit(op, op._opcode);
+                    return;
+                }
+            }
+            // the handler may destroy the transport
+            auto handler = std::move(op._handler);
+            op._handler = nullptr;
+            handler(ec, op._done);
+        }
+    };
+
+
+    template <typename Transport>
+    struct io_backend_tag
+    {
+        using transport = Transport;
+    };
+
+    template <typename Function>
+    void with_io_backend(io_backend backend, Function&& function)
+    {
+        if (backend == io_backend::asio) {
+            function(io_backend_tag<asio_transport>());
+        } else if (backend == io_backend::epoll) {
+            function(io_backend_tag<epoll_transport>());
+        } else {
+            function(io_backend_tag<uring_transport>());
+        }
+    }
+
+}
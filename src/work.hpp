@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace demo
+{
+
+    // comma separated steps spin:N, hash:N, sleep:N and read:N
+    class simulated_work
+    {
+    private: // --- scope ---
+        using self = simulated_work;
+        enum class kind { spin, hash, sleep, read };
+        struct step
+        {
+            kind _kind;
+            std::size_t _amount;
+        };
+    private: // --- state ---
+        std::vector<step> _steps;
+        int _fd = -1;
+        std::size_t _file_size = 0;
+    public: // --- life ---
+        explicit simulated_work(std::string_view spec)
+        {
+            while (!spec.empty()) {
+                auto item = spec.substr(0, spec.find(','));
+                spec.remove_prefix(std::min(item.size() + 1, spec.size()));
+                _steps.push_back(_parse(item));
+                if (_steps.back()._kind == kind::read && _fd == -1) {
+                    _open();
+                }
+            }
+        }
+        simulated_work(const self& rhs) = delete;
+        simulated_work(self&& rhs) noexcept = delete;
+        ~simulated_work() noexcept
+        {
+            if (_fd != -1) {
+                ::close(_fd);
+            }
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        bool empty() const { return _steps.empty(); }
+        void operator()(const char* data, std::size_t size) const
+        {
+            for (auto&& step : _steps) {
+                switch (step._kind) {
+                case kind::spin:
+                    _spin(std::chrono::microseconds(step._amount));
+                    break;
+                case kind::hash:
+                    _hash(data, size, step._amount);
+                    break;
+                case kind::sleep:
+                    std::this_thread::sleep_for(std::chrono::microseconds(step._amount));
+                    break;
+                case kind::read:
+                    _read(step._amount);
+                    break;
+                }
+            }
+        }
+    private:
+        static auto _parse(std::string_view item) -> step
+        {
+            auto colon = item.find(':');
+            if (colon == std::string_view::npos) {
+                throw std::runtime_error("work-spec-error");
+            }
+            auto name = item.substr(0, colon);
+            auto amount = std::stoul(std::string(item.substr(colon + 1)));
+            if (name == "spin") {
+                return {kind::spin, amount};
+            } else if (name == "hash") {
+                return {kind::hash, amount};
+            } else if (name == "sleep") {
+                return {kind::sleep, amount};
+            } else if (name == "read") {
+                return {kind::read, amount};
+            } else {
+                throw std::runtime_error("work-spec-error");
+            }
+        }
+        void _open()
+        {
+            _fd = ::open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (_fd == -1) {
+                throw std::runtime_error("work-open-error");
+            }
+            if (::fstat(_fd, &st) != 0) {
+                ::close(_fd);
+                _fd = -1;
+                throw std::runtime_error("work-open-error");
+            }
+            _file_size = static_cast<std::size_t>(st.st_size);
+        }
+        static void _spin(std::chrono::microseconds duration)
+        {
+            auto until = std::chrono::steady_clock::now() + duration;
+            while (std::chrono::steady_clock::now() < until) {
+                // spin
+            }
+        }
+        static void _hash(const char* data, std::size_t size, std::size_t rounds)
+        {
+            std::uint64_t hash = 14695981039346656037ull;
+            for (std::size_t r = 0; r != rounds; ++r) {
+                for (std::size_t i = 0; i != size; ++i) {
+                    hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+                }
+            }
+            // keep the compiler from discarding the loop
+            asm volatile("" : : "r"(hash));
+        }
+        void _read(std::size_t size) const
+        {
+            thread_local std::minstd_rand random(std::random_device{}());
+            thread_local std::vector<char> buffer;
+            buffer.resize(size);
+            auto offset = _file_size > size ? random() % (_file_size - size) : 0;
+            for (std::size_t n = 0; n != size; ) {
+                auto rv = ::pread(_fd, buffer.data() + n, size - n, static_cast<off_t>(offset + n));
+                if (rv > 0) {
+                    n += static_cast<std::size_t>(rv);
+                } else if (rv == 0 || errno != EINTR) {
+                    break;
+                }
+            }
+        }
+    };
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+
+namespace demo
+{
+
+    inline bool enable_zerocopy(int fd)
+    {
+        int value = 1;
+        return ::setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) == 0;
+    }
+
+
+    class zerocopy_tracker
+    {
+    private: // --- state ---
+        std::uint32_t _sent = 0;
+        std::uint32_t _done = 0; // number of completed sends
+    public: // --- operations ---
+        void sent() { ++_sent; }
+        bool pending() const { return _sent != _done; }
+        bool poll(int fd)
+        {
+            for (;;) {
+                char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+                msghdr msg = {};
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+                ssize_t rv = ::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+                if (rv == -1 && errno == EINTR) {
+                    continue;
+                } else if (rv == -1) {
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                    if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                        || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                        auto err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+                        if (err->ee_errno == 0 && err->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                            // the ranges may arrive out of order
+                            _done += err->ee_data - err->ee_info + 1;
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+}